@@ -112,6 +112,51 @@ void block_write(struct block* block, block_sector_t sector, const void* buffer)
   block->write_cnt++;
 }
 
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Devices that support it transfer all of them with as
+   few commands as possible.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void block_read_multiple(struct block* block, block_sector_t sector, block_sector_t cnt,
+                         void* buffer) {
+  if (cnt == 0)
+    return;
+  check_sector(block, sector);
+  check_sector(block, sector + cnt - 1);
+  if (block->ops->read_multiple != NULL)
+    block->ops->read_multiple(block->aux, sector, cnt, buffer);
+  else {
+    block_sector_t i;
+    for (i = 0; i < cnt; i++)
+      block->ops->read(block->aux, sector + i, (uint8_t*)buffer + i * BLOCK_SECTOR_SIZE);
+  }
+  block->read_cnt += cnt;
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void block_write_multiple(struct block* block, block_sector_t sector, block_sector_t cnt,
+                          const void* buffer) {
+  if (cnt == 0)
+    return;
+  check_sector(block, sector);
+  check_sector(block, sector + cnt - 1);
+  ASSERT(block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multiple != NULL)
+    block->ops->write_multiple(block->aux, sector, cnt, buffer);
+  else {
+    block_sector_t i;
+    for (i = 0; i < cnt; i++)
+      block->ops->write(block->aux, sector + i, (const uint8_t*)buffer + i * BLOCK_SECTOR_SIZE);
+  }
+  block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t block_size(struct block* block) { return block->size; }
 
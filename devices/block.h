@@ -52,6 +52,8 @@ struct block* block_next(struct block*);
 block_sector_t block_size(struct block*);
 void block_read(struct block*, block_sector_t, void*);
 void block_write(struct block*, block_sector_t, const void*);
+void block_read_multiple(struct block*, block_sector_t, block_sector_t cnt, void*);
+void block_write_multiple(struct block*, block_sector_t, block_sector_t cnt, const void*);
 const char* block_name(struct block*);
 enum block_type block_type(struct block*);
 
@@ -63,6 +65,12 @@ void block_print_stats(void);
 struct block_operations {
   void (*read)(void* aux, block_sector_t, void* buffer);
   void (*write)(void* aux, block_sector_t, const void* buffer);
+
+  /* Optional.  Transfer CNT consecutive sectors at once; if
+     null, the block layer falls back to one READ or WRITE per
+     sector. */
+  void (*read_multiple)(void* aux, block_sector_t, block_sector_t cnt, void* buffer);
+  void (*write_multiple)(void* aux, block_sector_t, block_sector_t cnt, const void* buffer);
 };
 
 struct block* block_register(const char* name, enum block_type, const char* extra_info,
@@ -3,12 +3,15 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -34,6 +37,7 @@
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -49,6 +53,51 @@
 #define CMD_IDENTIFY_DEVICE 0xec    /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20  /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4      /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5     /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6  /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8           /* READ DMA. */
+#define CMD_WRITE_DMA 0xca          /* WRITE DMA. */
+
+/* PCI configuration space access. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+#define PCI_REG_ID 0x00         /* Vendor and device ID. */
+#define PCI_REG_COMMAND 0x04    /* Command register (low 16 bits). */
+#define PCI_REG_CLASS 0x08      /* Class, subclass, programming interface. */
+#define PCI_REG_BAR4 0x20       /* Bus master IDE I/O base. */
+#define PCI_CMD_IO 0x0001       /* I/O space enable. */
+#define PCI_CMD_MASTER 0x0004   /* Bus master enable. */
+#define PCI_CLASS_IDE 0x0101    /* Mass storage, IDE. */
+#define PCI_PROGIF_MASTER 0x80  /* IDE controller can bus master. */
+
+/* Bus master IDE port addresses, relative to a channel's
+   bus master base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table address. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01 /* Start/stop transfer. */
+#define BM_CMD_READ 0x08  /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERR 0x02  /* Error, write 1 to clear. */
+#define BM_STA_INTR 0x04 /* Interrupt, write 1 to clear. */
+
+/* A Physical Region Descriptor: one physically contiguous piece
+   of a DMA buffer.  A PRD table is an array of these whose last
+   entry has PRD_EOT set. */
+struct prd {
+  uint32_t addr;  /* Physical address, must be even. */
+  uint16_t size;  /* Byte count, 0 for 64 kB. */
+  uint16_t flags; /* PRD_EOT on the last entry. */
+};
+#define PRD_EOT 0x8000
+
+/* Maximum number of sectors transferred by a single command.
+   The sector count register holds 0 for 256. */
+#define IDE_MAX_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk {
@@ -56,6 +105,10 @@ struct ata_disk {
   struct channel* channel; /* Channel that disk is attached to. */
   int dev_no;              /* Device 0 or 1 for master or slave. */
   bool is_ata;             /* Is device an ATA disk? */
+  int multiple;            /* Sectors per interrupt for READ/WRITE
+                              MULTIPLE, or 0 if the disk does not
+                              support them. */
+  bool dma;                /* Use READ/WRITE DMA? */
 };
 
 /* An ATA channel (aka controller).
@@ -70,6 +123,9 @@ struct channel {
                                    any interrupt would be spurious. */
   struct semaphore completion_wait; /* Up'd by interrupt handler. */
 
+  uint16_t bm_base;  /* Bus master I/O base, or 0 if DMA is unavailable. */
+  struct prd* prdt;  /* PRD table, one page. */
+
   struct ata_disk devices[2]; /* The devices on this channel. */
 };
 
@@ -82,8 +138,13 @@ static struct block_operations ide_operations;
 static void reset_channel(struct channel*);
 static bool check_device_type(struct ata_disk*);
 static void identify_ata_device(struct ata_disk*);
+static int set_multiple_mode(struct ata_disk*, int max);
+static uint16_t find_bus_master(void);
+static bool dma_usable(const struct ata_disk*, const void* buffer);
+static void dma_transfer(struct ata_disk*, block_sector_t, block_sector_t cnt, void* buffer,
+                         bool write);
 
-static void select_sector(struct ata_disk*, block_sector_t);
+static void select_sector(struct ata_disk*, block_sector_t, block_sector_t cnt);
 static void issue_pio_command(struct channel*, uint8_t command);
 static void input_sector(struct channel*, void*);
 static void output_sector(struct channel*, const void*);
@@ -98,6 +159,7 @@ static void interrupt_handler(struct intr_frame*);
 /* Initialize the disk subsystem and detect disks. */
 void ide_init(void) {
   size_t chan_no;
+  uint16_t bm_base = find_bus_master();
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
     struct channel* c = &channels[chan_no];
@@ -121,6 +183,16 @@ void ide_init(void) {
     c->expecting_interrupt = false;
     sema_init(&c->completion_wait, 0);
 
+    /* Each channel owns 8 bus master ports, primary first.
+       Without a PRD table we stick to PIO. */
+    c->bm_base = 0;
+    c->prdt = NULL;
+    if (bm_base != 0) {
+      c->prdt = palloc_get_page(0);
+      if (c->prdt != NULL)
+        c->bm_base = bm_base + chan_no * 8;
+    }
+
     /* Initialize devices. */
     for (dev_no = 0; dev_no < 2; dev_no++) {
       struct ata_disk* d = &c->devices[dev_no];
@@ -128,6 +200,8 @@ void ide_init(void) {
       d->channel = c;
       d->dev_no = dev_no;
       d->is_ata = false;
+      d->multiple = 0;
+      d->dma = false;
     }
 
     /* Register interrupt handler. */
@@ -264,6 +338,15 @@ static void identify_ata_device(struct ata_disk* d) {
   serial = descramble_ata_string(&id[27 * 2], 40);
   snprintf(extra_info, sizeof extra_info, "model \"%s\", serial \"%s\"", model, serial);
 
+  /* Word 47 holds the largest number of sectors the disk can
+     transfer per interrupt with READ/WRITE MULTIPLE. */
+  d->multiple = set_multiple_mode(d, *(uint16_t*)&id[47 * 2] & 0xff);
+
+  /* Word 49 bit 8 is set if the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t*)&id[49 * 2] & 0x100) != 0;
+  if (d->dma)
+    strlcat(extra_info, ", DMA", sizeof extra_info);
+
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
      allow access to those, we're less likely to scribble on
@@ -306,53 +389,242 @@ static char* descramble_ata_string(char* string, int size) {
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Enables READ/WRITE MULTIPLE on disk D with up to MAX sectors
+   per interrupt.  Returns the number of sectors per interrupt,
+   or 0 if the disk rejects the command or does not support it. */
+static int set_multiple_mode(struct ata_disk* d, int max) {
+  struct channel* c = d->channel;
+
+  if (max <= 1)
+    return 0;
+
+  select_device_wait(d);
+  outb(reg_nsect(c), max);
+  issue_pio_command(c, CMD_SET_MULTIPLE_MODE);
+  sema_down(&c->completion_wait);
+  wait_while_busy(d);
+  if (inb(reg_status(c)) & STA_ERR)
+    return 0;
+  return max;
+}
+
+/* Bus master DMA. */
+
+/* Reads 32-bit register REG from the configuration space of PCI
+   function FUNC of device DEV on bus BUS. */
+static uint32_t pci_read_config(int bus, int dev, int func, int reg) {
+  outl(PCI_CONFIG_ADDRESS, 0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  return inl(PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to 32-bit register REG in the configuration space
+   of PCI function FUNC of device DEV on bus BUS. */
+static void pci_write_config(int bus, int dev, int func, int reg, uint32_t value) {
+  outl(PCI_CONFIG_ADDRESS, 0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | (reg & 0xfc));
+  outl(PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can bus master,
+   such as the PIIX found in QEMU, and enables bus mastering on
+   it.  Returns its bus master I/O base, or 0 if there is none. */
+static uint16_t find_bus_master(void) {
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++) {
+      uint32_t class, bar, command;
+
+      if ((pci_read_config(0, dev, func, PCI_REG_ID) & 0xffff) == 0xffff)
+        continue;
+      class = pci_read_config(0, dev, func, PCI_REG_CLASS);
+      if ((class >> 16) != PCI_CLASS_IDE || !(class & (PCI_PROGIF_MASTER << 8)))
+        continue;
+
+      /* BAR4 must be an I/O space BAR. */
+      bar = pci_read_config(0, dev, func, PCI_REG_BAR4);
+      if (!(bar & 1) || (bar & ~3u) == 0)
+        continue;
+
+      command = pci_read_config(0, dev, func, PCI_REG_COMMAND);
+      pci_write_config(0, dev, func, PCI_REG_COMMAND, command | PCI_CMD_IO | PCI_CMD_MASTER);
+      return bar & 0xfffc;
+    }
+  return 0;
+}
+
+/* Returns true if a transfer to or from BUFFER on disk D can use
+   DMA.  The controller needs physical addresses, so BUFFER must
+   be in kernel memory, where virtual and physical addresses map
+   one to one, and must be word aligned. */
+static bool dma_usable(const struct ata_disk* d, const void* buffer) {
+  return d->dma && is_kernel_vaddr(buffer) && ((uintptr_t)buffer & 1) == 0;
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER by bus master DMA, from the disk if WRITE is false.
+   BUFFER must satisfy dma_usable().  The calling thread sleeps
+   until the completion interrupt instead of copying the data
+   itself.  D's channel lock must be held. */
+static void dma_transfer(struct ata_disk* d, block_sector_t sec_no, block_sector_t cnt,
+                         void* buffer, bool write) {
+  struct channel* c = d->channel;
+  uint8_t* p = buffer;
+  size_t left = cnt * BLOCK_SECTOR_SIZE;
+  size_t prd_cnt = 0;
+  uint8_t bm_status, status;
+
+  ASSERT(lock_held_by_current_thread(&c->lock));
+  ASSERT(cnt > 0 && cnt <= IDE_MAX_SECTORS);
+
+  /* Build the PRD table.  Entries end at page boundaries, which
+     keeps each of them physically contiguous and inside one 64 kB
+     region as the controller requires. */
+  while (left > 0) {
+    size_t size = PGSIZE - pg_ofs(p);
+    if (size > left)
+      size = left;
+    c->prdt[prd_cnt].addr = vtop(p);
+    c->prdt[prd_cnt].size = size;
+    c->prdt[prd_cnt].flags = 0;
+    prd_cnt++;
+    p += size;
+    left -= size;
+  }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+
+  /* Program the controller, then the disk, then start. */
+  outl(reg_bm_prdt(c), vtop(c->prdt));
+  outb(reg_bm_command(c), write ? 0 : BM_CMD_READ);
+  outb(reg_bm_status(c), inb(reg_bm_status(c)) | BM_STA_ERR | BM_STA_INTR);
+  select_sector(d, sec_no, cnt);
+  issue_pio_command(c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb(reg_bm_command(c), (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+  sema_down(&c->completion_wait);
+
+  /* Stop the controller and check for errors. */
+  outb(reg_bm_command(c), write ? 0 : BM_CMD_READ);
+  bm_status = inb(reg_bm_status(c));
+  outb(reg_bm_status(c), bm_status | BM_STA_ERR | BM_STA_INTR);
+  status = inb(reg_alt_status(c));
+  if ((bm_status & BM_STA_ERR) || (status & STA_ERR))
+    PANIC("%s: disk %s failed, sector=%" PRDSNu, d->name, write ? "write" : "read", sec_no);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Issues one command per IDE_MAX_SECTORS sectors.  Uses DMA if
+   possible; otherwise takes one interrupt per D->multiple sectors
+   if the disk supports READ MULTIPLE or one per sector.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
-static void ide_read(void* d_, block_sector_t sec_no, void* buffer) {
+static void ide_read_multiple(void* d_, block_sector_t sec_no, block_sector_t cnt, void* buffer_) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
+  uint8_t* buffer = buffer_;
+  block_sector_t per_intr = d->multiple > 0 ? d->multiple : 1;
+  bool use_dma = dma_usable(d, buffer);
+
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
-  issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-  sema_down(&c->completion_wait);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-  input_sector(c, buffer);
+  while (cnt > 0) {
+    block_sector_t cmd_cnt = cnt < IDE_MAX_SECTORS ? cnt : IDE_MAX_SECTORS;
+    block_sector_t done = 0;
+
+    if (use_dma) {
+      dma_transfer(d, sec_no, cmd_cnt, buffer, false);
+      done = cmd_cnt;
+    } else {
+      select_sector(d, sec_no, cmd_cnt);
+      issue_pio_command(c, d->multiple > 0 ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+    }
+    while (done < cmd_cnt) {
+      block_sector_t block_cnt = cmd_cnt - done < per_intr ? cmd_cnt - done : per_intr;
+      sema_down(&c->completion_wait);
+      if (!wait_while_busy(d))
+        PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no + done);
+      for (; block_cnt > 0; block_cnt--, done++)
+        input_sector(c, buffer + done * BLOCK_SECTOR_SIZE);
+    }
+
+    sec_no += cmd_cnt;
+    buffer += cmd_cnt * BLOCK_SECTOR_SIZE;
+    cnt -= cmd_cnt;
+  }
   lock_release(&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data.
+   Issues commands as ide_read_multiple().
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
-static void ide_write(void* d_, block_sector_t sec_no, const void* buffer) {
+static void ide_write_multiple(void* d_, block_sector_t sec_no, block_sector_t cnt,
+                               const void* buffer_) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
+  const uint8_t* buffer = buffer_;
+  block_sector_t per_intr = d->multiple > 0 ? d->multiple : 1;
+  bool use_dma = dma_usable(d, buffer);
+
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
-  issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-  output_sector(c, buffer);
-  sema_down(&c->completion_wait);
+  while (cnt > 0) {
+    block_sector_t cmd_cnt = cnt < IDE_MAX_SECTORS ? cnt : IDE_MAX_SECTORS;
+    block_sector_t done = 0;
+
+    if (use_dma) {
+      dma_transfer(d, sec_no, cmd_cnt, (void*)buffer, true);
+      done = cmd_cnt;
+    } else {
+      select_sector(d, sec_no, cmd_cnt);
+      issue_pio_command(c, d->multiple > 0 ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+    }
+    while (done < cmd_cnt) {
+      block_sector_t block_cnt = cmd_cnt - done < per_intr ? cmd_cnt - done : per_intr;
+      if (!wait_while_busy(d))
+        PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no + done);
+      for (; block_cnt > 0; block_cnt--, done++)
+        output_sector(c, buffer + done * BLOCK_SECTOR_SIZE);
+      sema_down(&c->completion_wait);
+    }
+
+    sec_no += cmd_cnt;
+    buffer += cmd_cnt * BLOCK_SECTOR_SIZE;
+    cnt -= cmd_cnt;
+  }
   lock_release(&c->lock);
 }
 
-static struct block_operations ide_operations = {ide_read, ide_write};
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void ide_read(void* d_, block_sector_t sec_no, void* buffer) {
+  ide_read_multiple(d_, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void ide_write(void* d_, block_sector_t sec_no, const void* buffer) {
+  ide_write_multiple(d_, sec_no, 1, buffer);
+}
+
+static struct block_operations ide_operations = {ide_read, ide_write, ide_read_multiple,
+                                                 ide_write_multiple};
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void select_sector(struct ata_disk* d, block_sector_t sec_no) {
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
+static void select_sector(struct ata_disk* d, block_sector_t sec_no, block_sector_t cnt) {
   struct channel* c = d->channel;
 
   ASSERT(sec_no < (1UL << 28));
+  ASSERT(cnt > 0 && cnt <= IDE_MAX_SECTORS);
 
   select_device_wait(d);
-  outb(reg_nsect(c), 1);
+  outb(reg_nsect(c), cnt == IDE_MAX_SECTORS ? 0 : cnt);
   outb(reg_lbal(c), sec_no);
   outb(reg_lbam(c), sec_no >> 8);
   outb(reg_lbah(c), (sec_no >> 16));
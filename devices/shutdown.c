@@ -12,6 +12,7 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #endif
 
 /* Keyboard control register port. */
@@ -118,6 +119,7 @@ static void print_stats(void) {
   thread_print_stats();
 #ifdef FILESYS
   block_print_stats();
+  buffer_cache_print_stats(fs_buffer_cache);
 #endif
   console_print_stats();
   kbd_print_stats();
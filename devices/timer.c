@@ -25,11 +25,16 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Threads blocked in timer_sleep(), a skew heap with the earliest
+   wakeup_tick at the root.  Only accessed with interrupts off. */
+static struct thread* sleepers;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
 static void real_time_delay(int64_t num, int32_t denom);
+static struct thread* sleep_merge(struct thread* a, struct thread* b);
 
 /* Sets up the timer to interrupt TIMER_FREQ times per second,
    and registers the corresponding interrupt. */
@@ -77,13 +82,21 @@ int64_t timer_elapsed(int64_t then) { return timer_ticks() - then; }
 /**Sleeps for approximately TICKS timer ticks.  Interrupts must
  * be turned on.
  * @Note: sleep is thread-specific, meaning other threads in the proc can run.
+ * The thread is blocked on the sleep queue until timer_interrupt() wakes it up.
  */
 void timer_sleep(int64_t ticks) {
   int64_t start = timer_ticks();
-  //TODO: implement timer_sleep
   ASSERT(intr_get_level() == INTR_ON);
-  while (timer_elapsed(start) < ticks)
-    thread_yield();
+  if (ticks <= 0)
+    return;
+
+  struct thread* t = thread_current();
+  enum intr_level old_level = intr_disable();
+  t->wakeup_tick = start + ticks;
+  t->sleep_left = t->sleep_right = NULL;
+  sleepers = sleep_merge(sleepers, t);
+  thread_block();
+  intr_set_level(old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -128,12 +141,40 @@ void timer_ndelay(int64_t ns) { real_time_delay(ns, 1000 * 1000 * 1000); }
 /* Prints timer statistics. */
 void timer_print_stats(void) { printf("Timer: %" PRId64 " ticks\n", timer_ticks()); }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Wakes up every sleeper whose time has come. */
 static void timer_interrupt(struct intr_frame* args UNUSED) {
   ticks++;
+  while (sleepers != NULL && sleepers->wakeup_tick <= ticks) {
+    struct thread* t = sleepers;
+    sleepers = sleep_merge(t->sleep_left, t->sleep_right);
+    thread_unblock(t);
+  }
   thread_tick();
 }
 
+/* Merges sleep queues A and B and returns the new root.  Top-down
+   skew heap merge: walks the right spines without recursion,
+   swapping the children of every node on the way so the heap
+   stays balanced in amortized O(log n). */
+static struct thread* sleep_merge(struct thread* a, struct thread* b) {
+  struct thread* root = NULL;
+  struct thread** link = &root;
+  while (a != NULL && b != NULL) {
+    if (b->wakeup_tick < a->wakeup_tick) {
+      struct thread* tmp = a;
+      a = b;
+      b = tmp;
+    }
+    struct thread* right = a->sleep_right;
+    a->sleep_right = a->sleep_left;
+    *link = a;
+    link = &a->sleep_left;
+    a = right;
+  }
+  *link = a != NULL ? a : b;
+  return root;
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool too_many_loops(unsigned loops) {
@@ -1,148 +1,893 @@
 #include "buffer_cache.h"
+#include <hash.h>
+#include <inttypes.h>
+#include <list.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "free-map.h"
 #include "inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "utils.h"
 
+/*Maximum number of adjacent dirty sectors written back with one command.*/
+#define BUFFER_CACHE_RUN_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* State of a cached_sector. Disk I/O on a sector happens without the global lock; LOADING and WRITING_BACK mark the
+  sectors it is in flight for, and threads that want such a sector wait on its CHANGED condition. */
+enum cached_sector_state {
+  CACHED_SECTOR_EMPTY,        /* Not in use. */
+  CACHED_SECTOR_LOADING,      /* Being read from disk, or filled by the writer that claimed it; not readable yet. */
+  CACHED_SECTOR_VALID,        /* Holds the sector's data. */
+  CACHED_SECTOR_WRITING_BACK  /* Being written to disk; its data must not change. */
+};
+
 struct cached_sector {
   block_sector_t sector_idx; /* Sector number; -1 if not in use. */
-  bool dirty; /* True if the cache has unflushed modifications. */
-  int64_t last_accessed; /* Last time the cache is accessed. If cache is inactive, this value is INT64_MIN. synchronized using the global lock. */
-  rwLock lock; /* Read-write lock for data accesses. */
-  uint8_t data[BLOCK_SECTOR_SIZE]; /* Cached data. */
+  enum cached_sector_state state; /* synchronized using the global lock. */
+  int pin_cnt; /* Number of threads accessing the data; a pinned sector is never evicted. synchronized using the global lock. */
+  bool dirty; /* True if the cache has unflushed modifications. synchronized using the global lock. */
+  bool prefetched; /* True if the sector was loaded by read-ahead and has not been accessed since. synchronized using the global lock. */
+  bool queued; /* True if the sector is in the cache's dirty list. synchronized using the global lock. */
+  bool write_locked; /* True while a thread holds LOCK for writing through buffer_cache_get(). */
+  enum buffer_cache_class class; /* Class given by the last access, while in use. synchronized using the global lock. */
+  int64_t dirty_since; /* Time the sector was queued as dirty. synchronized using the global lock. */
+  struct hash_elem hash_elem; /* Element in the cache's sector index; only present while the sector is in use. */
+  int queue; /* Index of the cache's RESIDENT list holding the sector, or -1 while it is in the FREE list. */
+  bool referenced; /* CLOCK: true if the sector was accessed since the hand last passed it. */
+  struct list_elem queue_elem; /* Element in the cache's FREE list or one of its RESIDENT lists. synchronized using the global lock. */
+  struct list_elem dirty_elem; /* Element in the cache's dirty list, only while QUEUED. */
+  struct condition changed; /* Signalled, with the global lock, when STATE or PIN_CNT changes. */
+  struct rw_lock lock; /* Read-write lock for data accesses by the threads pinning the sector. */
+  uint8_t* data; /* Cached data, BLOCK_SECTOR_SIZE bytes owned by the buffer cache. */
+};
+
+/* Number of a sector evicted recently, remembered without its data by the 2Q and ARC policies. */
+struct cache_ghost {
+  block_sector_t sector_idx;
+  int list; /* Index of the cache's GHOST list holding the entry, or -1 while it is unused. */
+  struct list_elem elem; /* Element in a GHOST list, or in the GHOST_FREE list. */
+  struct hash_elem hash_elem; /* Element in the cache's ghost index, only while in use. */
+};
+
+/* Replacement policy of a buffer cache. Every function is called with the global lock held. Sectors not in use are
+  kept in the cache's FREE list and are always taken first; the policy only decides among the sectors in use, which
+  it keeps in the cache's RESIDENT lists. */
+struct buffer_cache_policy {
+  /* Return a sector in use that is neither pinned nor in flight, to be evicted to make room for A_SECTOR, or NULL if
+    there is none. If A_DATA_ONLY, metadata sectors are not candidates. The caller may give up on the victim, so the
+    sectors must stay tracked. */
+  struct cached_sector* (*victim)(buffer_cache_t* a_cache, block_sector_t a_sector, bool a_data_only);
+  /* Start tracking A_SECTOR, newly indexed as SECTOR_IDX. */
+  void (*insert)(buffer_cache_t* a_cache, struct cached_sector* a_sector);
+  /* A_SECTOR was accessed. */
+  void (*access)(buffer_cache_t* a_cache, struct cached_sector* a_sector);
+  /* Stop tracking A_SECTOR, about to be evicted to make room for A_INCOMING. Called while it still holds SECTOR_IDX.
+    Any ghost entry of A_INCOMING must survive, as insert() looks it up again afterwards. */
+  void (*evict)(buffer_cache_t* a_cache, struct cached_sector* a_sector, block_sector_t a_incoming);
 };
 
 
 struct buffer_cache {
-  struct lock lock; /* Global lock for the buffer cache, acquired when updating/searching for entries.*/
+  struct lock lock; /* Global lock for the buffer cache, acquired when updating/searching for entries. Never held during disk I/O.*/
+  struct condition slot_freed; /* Signalled when a sector may have become evictable. */
   struct block* block_device; /* Block device to cache. */
   int num_hit;
   int num_miss;
-  struct cached_sector sectors[BUFFER_CACHE_SIZE]
+  int num_class_hit[2]; /* NUM_HIT, by enum buffer_cache_class. */
+  int num_class_miss[2]; /* NUM_MISS, by enum buffer_cache_class. */
+  size_t class_cnt[2]; /* Number of sectors in use of each class. */
+  size_t meta_reserve; /* Metadata sectors, up to this many, are not evicted to make room for data. */
+  int num_prefetch; /* Number of sectors loaded by read-ahead. */
+  int num_prefetch_hit; /* Number of sectors loaded by read-ahead that were accessed before being evicted. */
+  struct hash index; /* Maps sector numbers to the cached_sectors holding them. */
+  const struct buffer_cache_policy* policy; /* Replacement policy; fixed at creation. */
+  struct list free; /* Sectors not in use. */
+  struct list resident[2]; /* Sectors in use, oldest first. LRU and CLOCK use the first list; 2Q keeps A1in and Am,
+                              ARC keeps T1 and T2. */
+  size_t resident_cnt[2];
+  struct list ghost[2]; /* Recently evicted sector numbers, oldest first. 2Q keeps A1out in the first list; ARC keeps
+                           B1 and B2. */
+  size_t ghost_cnt[2];
+  struct hash ghost_index; /* Maps sector numbers to the cache_ghosts remembering them. */
+  struct list ghost_free; /* Unused cache_ghosts. */
+  struct cache_ghost* ghosts; /* SIZE ghost entries, backed by GHOSTS_PAGES pages. */
+  size_t ghosts_pages;
+  size_t clock_hand; /* CLOCK: index of the next sector the hand looks at. */
+  size_t arc_target; /* ARC: adaptive target size of T1. */
+  struct list dirty; /* Queued dirty sectors, oldest first. */
+  size_t num_dirty; /* Number of sectors in DIRTY. */
+  size_t dirty_limit; /* Dirty-count high-water mark for the flusher. */
+  struct lock ra_lock; /* Lock for the read-ahead queue. */
+  struct semaphore ra_pending; /* Number of sectors in the read-ahead queue. */
+  block_sector_t ra_queue[BUFFER_CACHE_READ_AHEAD_QUEUE]; /* Ring buffer of sectors to prefetch. */
+  size_t ra_head; /* Index of the oldest sector in RA_QUEUE. */
+  size_t ra_count; /* Number of sectors in RA_QUEUE. */
+  size_t size; /* Number of sectors cached. */
+  struct cached_sector* sectors; /* SIZE cached sectors, backed by SECTORS_PAGES pages. */
+  size_t sectors_pages;
+  uint8_t* data; /* SIZE * BLOCK_SECTOR_SIZE bytes of cached data, backed by DATA_PAGES pages. */
+  size_t data_pages;
+  uint8_t* run_buffer; /* One page used to move runs of adjacent sectors with a single command. */
+  bool run_buffer_busy; /* True while a write-back or a multi-sector read uses RUN_BUFFER. synchronized using the global lock. */
+  int num_write_back; /* Number of sectors written back. */
+  int num_write_cmd; /* Number of disk commands used to write them. */
+  int flush_write_back; /* Sectors written back by the last buffer_cache_flush(). */
+  int flush_write_cmd; /* Disk commands used by the last buffer_cache_flush(). */
+  int64_t flush_ticks; /* Ticks taken by the last buffer_cache_flush(). */
 };
 
-/*Write back data from A_CACHE into its corresponding sector in disk, if the cache is dirty. .*/
-static void cached_sector_flush(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+size_t buffer_cache_size = BUFFER_CACHE_DEFAULT_SIZE;
+int64_t buffer_cache_dirty_age = BUFFER_CACHE_DEFAULT_DIRTY_AGE;
+size_t buffer_cache_dirty_limit = 0;
+enum buffer_cache_policy_type buffer_cache_policy = BUFFER_CACHE_POLICY_LRU;
+size_t buffer_cache_meta_reserve = 0;
+
+static unsigned cached_sector_hash(const struct hash_elem* a_e, void* aux UNUSED) {
+  return hash_int(hash_entry(a_e, struct cached_sector, hash_elem)->sector_idx);
+}
+
+static bool cached_sector_less(const struct hash_elem* a_a, const struct hash_elem* a_b, void* aux UNUSED) {
+  return hash_entry(a_a, struct cached_sector, hash_elem)->sector_idx < hash_entry(a_b, struct cached_sector, hash_elem)->sector_idx;
+}
+
+static unsigned cache_ghost_hash(const struct hash_elem* a_e, void* aux UNUSED) {
+  return hash_int(hash_entry(a_e, struct cache_ghost, hash_elem)->sector_idx);
+}
+
+static bool cache_ghost_less(const struct hash_elem* a_a, const struct hash_elem* a_b, void* aux UNUSED) {
+  return hash_entry(a_a, struct cache_ghost, hash_elem)->sector_idx < hash_entry(a_b, struct cache_ghost, hash_elem)->sector_idx;
+}
+
+/*Return the cached_sector holding A_SECTOR, or NULL if A_SECTOR is not cached.*/
+static struct cached_sector* buffer_cache_lookup(buffer_cache_t* a_cache, block_sector_t a_sector) {
   ASSERT(lock_held_by_current_thread(&a_cache->lock));
-  if (a_sector->last_accessed == INT64_MIN) {
-    return;
+  struct cached_sector key;
+  key.sector_idx = a_sector;
+  struct hash_elem* e = hash_find(&a_cache->index, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct cached_sector, hash_elem) : NULL;
+}
+
+/*Set the state of A_SECTOR and wake the threads waiting for it.*/
+static void cached_sector_set_state(buffer_cache_t* a_cache, struct cached_sector* a_sector, enum cached_sector_state a_state) {
+  ASSERT(lock_held_by_current_thread(&a_cache->lock));
+  a_sector->state = a_state;
+  cond_broadcast(&a_sector->changed, &a_cache->lock);
+  if (a_state == CACHED_SECTOR_VALID && a_sector->pin_cnt == 0) {
+    cond_broadcast(&a_cache->slot_freed, &a_cache->lock);
+  }
+}
+
+/*Return true if A_SECTOR is being read or written by the disk.*/
+static bool cached_sector_in_flight(const struct cached_sector* a_sector) {
+  return a_sector->state == CACHED_SECTOR_LOADING || a_sector->state == CACHED_SECTOR_WRITING_BACK;
+}
+
+/*Return true if A_SECTOR may be written back right away.*/
+static bool cached_sector_flushable(const struct cached_sector* a_sector) {
+  return a_sector->state == CACHED_SECTOR_VALID && a_sector->pin_cnt == 0 && a_sector->dirty;
+}
+
+/*Append A_SECTOR to the RESIDENT list A_QUEUE of A_CACHE.*/
+static void cached_sector_enqueue(buffer_cache_t* a_cache, struct cached_sector* a_sector, int a_queue) {
+  a_sector->queue = a_queue;
+  list_push_back(&a_cache->resident[a_queue], &a_sector->queue_elem);
+  a_cache->resident_cnt[a_queue]++;
+}
+
+/*Remove A_SECTOR from the RESIDENT list holding it.*/
+static void cached_sector_dequeue(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  ASSERT(a_sector->queue != -1);
+  list_remove(&a_sector->queue_elem);
+  a_cache->resident_cnt[a_sector->queue]--;
+  a_sector->queue = -1;
+}
+
+/*Return true if A_SECTOR, in use, may be chosen as a victim. If A_DATA_ONLY, metadata sectors may not.*/
+static bool cached_sector_evictable(const struct cached_sector* a_sector, bool a_data_only) {
+  return a_sector->pin_cnt == 0 && !cached_sector_in_flight(a_sector) && !(a_data_only && a_sector->class == BUFFER_CACHE_META);
+}
+
+/*Return the oldest sector of the RESIDENT list A_QUEUE that cached_sector_evictable() accepts, or NULL.*/
+static struct cached_sector* buffer_cache_oldest_idle(buffer_cache_t* a_cache, int a_queue, bool a_data_only) {
+  struct list* queue = &a_cache->resident[a_queue];
+  for (struct list_elem* e = list_begin(queue); e != list_end(queue); e = list_next(e)) {
+    struct cached_sector* one_sector = list_entry(e, struct cached_sector, queue_elem);
+    if (cached_sector_evictable(one_sector, a_data_only)) {
+      return one_sector;
+    }
   }
-  wLock_acquire(&a_sector->lock);
-  if (a_sector->dirty) {
-    // write back
-    block_write(a_cache->block_device, a_sector->sector_idx, a_sector->data);
-    // update dirty status
-    a_sector->dirty = false;
+  return NULL;
+}
+
+/*Return the ghost entry remembering A_SECTOR, or NULL.*/
+static struct cache_ghost* buffer_cache_find_ghost(buffer_cache_t* a_cache, block_sector_t a_sector) {
+  struct cache_ghost key;
+  key.sector_idx = a_sector;
+  struct hash_elem* e = hash_find(&a_cache->ghost_index, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct cache_ghost, hash_elem) : NULL;
+}
+
+/*Forget A_GHOST.*/
+static void buffer_cache_drop_ghost(buffer_cache_t* a_cache, struct cache_ghost* a_ghost) {
+  ASSERT(a_ghost->list != -1);
+  hash_delete(&a_cache->ghost_index, &a_ghost->hash_elem);
+  list_remove(&a_ghost->elem);
+  a_cache->ghost_cnt[a_ghost->list]--;
+  a_ghost->list = -1;
+  list_push_back(&a_cache->ghost_free, &a_ghost->elem);
+}
+
+/*Forget the oldest entry of the GHOST list A_LIST, if any.*/
+static void buffer_cache_drop_oldest_ghost(buffer_cache_t* a_cache, int a_list) {
+  if (!list_empty(&a_cache->ghost[a_list])) {
+    buffer_cache_drop_ghost(a_cache, list_entry(list_front(&a_cache->ghost[a_list]), struct cache_ghost, elem));
   }
-  wLock_release(&a_sector->lock);
 }
 
-/*Find the cached buffer from the cache, or cache the sector and then return the cached buffer, evicting any old buffer if necessary.
-  A_LOAD_DATA is set to false ONLY when loading data isn't necessary for the cache to function i.e. exactly one block of data is being written to the cache.*/
-static struct cached_sector* buffer_cache_fetch(buffer_cache_t* a_cache, block_sector_t a_sector, bool a_load_data) {
-  struct cached_sector* lru_sector = NULL;
-  struct cached_sector* ret = NULL;
-  bool hit = false;
-  int64_t lru_accessed = INT64_MAX;
-  // Find
-  lock_acquire(&a_cache->lock);
+/*Return the oldest entry of the GHOST list A_LIST that doesn't remember A_KEEP, or NULL.*/
+static struct cache_ghost* buffer_cache_oldest_ghost_but(buffer_cache_t* a_cache, int a_list, block_sector_t a_keep) {
+  struct list* ghosts = &a_cache->ghost[a_list];
+  for (struct list_elem* e = list_begin(ghosts); e != list_end(ghosts); e = list_next(e)) {
+    struct cache_ghost* ghost = list_entry(e, struct cache_ghost, elem);
+    if (ghost->sector_idx != a_keep) {
+      return ghost;
+    }
+  }
+  return NULL;
+}
 
-  for (int i = 0; i < BUFFER_CACHE_SIZE; i++) {
-    struct cached_sector* one_sector = a_cache->sectors + i;
-    if (one_sector->sector_idx == a_sector) {
-      ret = one_sector;
-      hit = true;
-      break;
+/*Remember A_SECTOR at the end of the GHOST list A_LIST. When every ghost entry is in use, the oldest entry of A_LIST,
+  or of the other list if A_LIST has none, is forgotten first; the entry remembering A_KEEP never is.*/
+static void buffer_cache_add_ghost(buffer_cache_t* a_cache, int a_list, block_sector_t a_sector, block_sector_t a_keep) {
+  if (list_empty(&a_cache->ghost_free)) {
+    struct cache_ghost* oldest = buffer_cache_oldest_ghost_but(a_cache, a_list, a_keep);
+    if (oldest == NULL) {
+      oldest = buffer_cache_oldest_ghost_but(a_cache, 1 - a_list, a_keep);
     }
-    // Find the least recently used sector; note that last_accessed is initialized to INT64_MIN, so any uninitialized sector will be prioritized.
-    if (one_sector->last_accessed < lru_accessed) {
-      lru_accessed = one_sector->last_accessed;
-      lru_sector = one_sector;
+    if (oldest == NULL) { // the only ghost entry is A_KEEP's
+      return;
     }
+    buffer_cache_drop_ghost(a_cache, oldest);
   }
+  struct cache_ghost* ghost = list_entry(list_pop_front(&a_cache->ghost_free), struct cache_ghost, elem);
+  ghost->sector_idx = a_sector;
+  ghost->list = a_list;
+  hash_insert(&a_cache->ghost_index, &ghost->hash_elem);
+  list_push_back(&a_cache->ghost[a_list], &ghost->elem);
+  a_cache->ghost_cnt[a_list]++;
+}
 
-  // Insertion
-  if (!hit) {
-    a_cache->num_miss++;
-    ASSERT(lru_sector != NULL); // sanity check
-    // Write back (if)on eviction
-    cached_sector_flush(a_cache, lru_sector);
-    // Data fetch
-    lru_sector->sector_idx = a_sector;
-    if (a_load_data) {
-      wLock_acquire(&lru_sector->lock);
-      block_read(a_cache->block_device, a_sector, lru_sector->data);
-      wLock_release(&lru_sector->lock);
+/*Forget every ghost entry of A_CACHE.*/
+static void buffer_cache_clear_ghosts(buffer_cache_t* a_cache) {
+  for (int i = 0; i < 2; i++) {
+    while (!list_empty(&a_cache->ghost[i])) {
+      buffer_cache_drop_oldest_ghost(a_cache, i);
+    }
+  }
+}
+
+/* LRU: evict the least recently accessed sector. */
+
+static struct cached_sector* lru_victim(buffer_cache_t* a_cache, block_sector_t a_sector UNUSED, bool a_data_only) {
+  return buffer_cache_oldest_idle(a_cache, 0, a_data_only);
+}
+
+static void lru_insert(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  cached_sector_enqueue(a_cache, a_sector, 0);
+}
+
+static void lru_access(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  cached_sector_dequeue(a_cache, a_sector);
+  cached_sector_enqueue(a_cache, a_sector, 0);
+}
+
+static void lru_evict(buffer_cache_t* a_cache, struct cached_sector* a_sector, block_sector_t a_incoming UNUSED) {
+  cached_sector_dequeue(a_cache, a_sector);
+}
+
+/* CLOCK: a hand sweeps the sectors in slot order, evicting the first one not accessed since the hand last passed
+  it. New sectors start unreferenced, so sectors read only once by a scan are evicted before the hot ones. */
+
+static struct cached_sector* clock_victim(buffer_cache_t* a_cache, block_sector_t a_sector UNUSED, bool a_data_only) {
+  // Two turns clear every reference bit, so an idle sector is found unless all are busy.
+  for (size_t i = 0; i < 2 * a_cache->size; i++) {
+    struct cached_sector* one_sector = a_cache->sectors + a_cache->clock_hand;
+    if (one_sector->queue != -1 && cached_sector_evictable(one_sector, a_data_only)) {
+      if (!one_sector->referenced) {
+        return one_sector;
+      }
+      one_sector->referenced = false;
+    }
+    a_cache->clock_hand = (a_cache->clock_hand + 1) % a_cache->size;
+  }
+  return NULL;
+}
+
+static void clock_insert(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  a_sector->referenced = false;
+  cached_sector_enqueue(a_cache, a_sector, 0);
+}
+
+static void clock_access(buffer_cache_t* a_cache UNUSED, struct cached_sector* a_sector) {
+  a_sector->referenced = true;
+}
+
+static void clock_evict(buffer_cache_t* a_cache, struct cached_sector* a_sector, block_sector_t a_incoming UNUSED) {
+  cached_sector_dequeue(a_cache, a_sector);
+  a_cache->clock_hand = (a_cache->clock_hand + 1) % a_cache->size;
+}
+
+/* 2Q (Johnson and Shasha): new sectors enter the FIFO A1in and only move to the LRU list Am when accessed again
+  after being evicted from A1in while their number is still remembered in A1out. A scan thus only cycles A1in. */
+
+#define TWO_Q_A1IN 0
+#define TWO_Q_AM 1
+#define TWO_Q_A1OUT 0
+
+static struct cached_sector* two_q_victim(buffer_cache_t* a_cache, block_sector_t a_sector UNUSED, bool a_data_only) {
+  size_t a1in_target = a_cache->size / 4 > 0 ? a_cache->size / 4 : 1;
+  int first = a_cache->resident_cnt[TWO_Q_A1IN] > a1in_target ? TWO_Q_A1IN : TWO_Q_AM;
+  struct cached_sector* ret = buffer_cache_oldest_idle(a_cache, first, a_data_only);
+  return ret != NULL ? ret : buffer_cache_oldest_idle(a_cache, 1 - first, a_data_only);
+}
+
+static void two_q_insert(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  struct cache_ghost* ghost = buffer_cache_find_ghost(a_cache, a_sector->sector_idx);
+  if (ghost != NULL) {
+    buffer_cache_drop_ghost(a_cache, ghost);
+    cached_sector_enqueue(a_cache, a_sector, TWO_Q_AM);
+  } else {
+    cached_sector_enqueue(a_cache, a_sector, TWO_Q_A1IN);
+  }
+}
+
+static void two_q_access(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  if (a_sector->queue == TWO_Q_AM) {
+    cached_sector_dequeue(a_cache, a_sector);
+    cached_sector_enqueue(a_cache, a_sector, TWO_Q_AM);
+  }
+}
+
+static void two_q_evict(buffer_cache_t* a_cache, struct cached_sector* a_sector, block_sector_t a_incoming) {
+  bool from_a1in = a_sector->queue == TWO_Q_A1IN;
+  cached_sector_dequeue(a_cache, a_sector);
+  if (from_a1in) {
+    buffer_cache_add_ghost(a_cache, TWO_Q_A1OUT, a_sector->sector_idx, a_incoming);
+    struct cache_ghost* oldest = buffer_cache_oldest_ghost_but(a_cache, TWO_Q_A1OUT, a_incoming);
+    if (a_cache->ghost_cnt[TWO_Q_A1OUT] > a_cache->size / 2 && oldest != NULL) {
+      buffer_cache_drop_ghost(a_cache, oldest);
     }
-    ret = lru_sector;
+  }
+}
+
+/* ARC (Megiddo and Modha): T1 holds sectors accessed once recently, T2 sectors accessed at least twice. Ghost lists
+  B1 and B2 remember what was evicted from each, and a miss found in one of them shifts the target size of T1 toward
+  the list that would have hit. */
+
+#define ARC_T1 0
+#define ARC_T2 1
+#define ARC_B1 0
+#define ARC_B2 1
+
+static struct cached_sector* arc_victim(buffer_cache_t* a_cache, block_sector_t a_sector, bool a_data_only) {
+  struct cache_ghost* ghost = buffer_cache_find_ghost(a_cache, a_sector);
+  size_t t1_cnt = a_cache->resident_cnt[ARC_T1];
+  bool in_b2 = ghost != NULL && ghost->list == ARC_B2;
+  int first = t1_cnt > 0 && (t1_cnt > a_cache->arc_target || (in_b2 && t1_cnt == a_cache->arc_target)) ? ARC_T1 : ARC_T2;
+  struct cached_sector* ret = buffer_cache_oldest_idle(a_cache, first, a_data_only);
+  return ret != NULL ? ret : buffer_cache_oldest_idle(a_cache, 1 - first, a_data_only);
+}
+
+static void arc_insert(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  // Looked up here rather than in arc_victim(): the eviction in between may have changed the ghost lists.
+  struct cache_ghost* ghost = buffer_cache_find_ghost(a_cache, a_sector->sector_idx);
+  if (ghost == NULL) {
+    cached_sector_enqueue(a_cache, a_sector, ARC_T1);
   } else {
-    a_cache->num_hit++;
+    size_t b1_cnt = a_cache->ghost_cnt[ARC_B1];
+    size_t b2_cnt = a_cache->ghost_cnt[ARC_B2];
+    if (ghost->list == ARC_B1) {
+      size_t delta = b2_cnt > b1_cnt ? b2_cnt / b1_cnt : 1;
+      a_cache->arc_target = a_cache->arc_target + delta < a_cache->size ? a_cache->arc_target + delta : a_cache->size;
+    } else {
+      size_t delta = b1_cnt > b2_cnt ? b1_cnt / b2_cnt : 1;
+      a_cache->arc_target = a_cache->arc_target > delta ? a_cache->arc_target - delta : 0;
+    }
+    buffer_cache_drop_ghost(a_cache, ghost);
+    cached_sector_enqueue(a_cache, a_sector, ARC_T2);
+  }
+  // Keep |T1| + |B1| <= c and |T1| + |T2| + |B1| + |B2| <= 2c.
+  while (a_cache->resident_cnt[ARC_T1] + a_cache->ghost_cnt[ARC_B1] > a_cache->size && a_cache->ghost_cnt[ARC_B1] > 0) {
+    buffer_cache_drop_oldest_ghost(a_cache, ARC_B1);
   }
+  while (a_cache->resident_cnt[ARC_T1] + a_cache->resident_cnt[ARC_T2] + a_cache->ghost_cnt[ARC_B1] + a_cache->ghost_cnt[ARC_B2] > 2 * a_cache->size
+         && a_cache->ghost_cnt[ARC_B2] > 0) {
+    buffer_cache_drop_oldest_ghost(a_cache, ARC_B2);
+  }
+}
 
-  ASSERT(ret != NULL);
-  // Update for LRU
-  ret->last_accessed = timer_ticks();
+static void arc_access(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  cached_sector_dequeue(a_cache, a_sector);
+  cached_sector_enqueue(a_cache, a_sector, ARC_T2);
+}
 
+static void arc_evict(buffer_cache_t* a_cache, struct cached_sector* a_sector, block_sector_t a_incoming) {
+  int queue = a_sector->queue;
+  cached_sector_dequeue(a_cache, a_sector);
+  buffer_cache_add_ghost(a_cache, queue == ARC_T1 ? ARC_B1 : ARC_B2, a_sector->sector_idx, a_incoming);
+}
+
+/*Replacement policies, indexed by enum buffer_cache_policy_type.*/
+static const struct buffer_cache_policy buffer_cache_policies[] = {
+  [BUFFER_CACHE_POLICY_LRU] = {lru_victim, lru_insert, lru_access, lru_evict},
+  [BUFFER_CACHE_POLICY_CLOCK] = {clock_victim, clock_insert, clock_access, clock_evict},
+  [BUFFER_CACHE_POLICY_2Q] = {two_q_victim, two_q_insert, two_q_access, two_q_evict},
+  [BUFFER_CACHE_POLICY_ARC] = {arc_victim, arc_insert, arc_access, arc_evict},
+};
+
+/*Write back A_SECTOR if it is dirty, together with the dirty sectors adjacent to it on disk, up to
+  BUFFER_CACHE_RUN_SECTORS of them, so that a run of dirty sectors costs one disk command instead of one per sector.
+  First waits until A_SECTOR is neither pinned nor in flight. The global lock is released during the disk write.*/
+static void cached_sector_flush_run(buffer_cache_t* a_cache, struct cached_sector* a_sector) {
+  ASSERT(lock_held_by_current_thread(&a_cache->lock));
+  while (a_sector->sector_idx != -1 && (a_sector->pin_cnt > 0 || cached_sector_in_flight(a_sector))) {
+    cond_wait(&a_sector->changed, &a_cache->lock);
+  }
+  if (a_sector->sector_idx == -1 || !a_sector->dirty) {
+    return;
+  }
+  // Walk back to the first sector of the run, close enough that the run still reaches A_SECTOR.
+  block_sector_t first = a_sector->sector_idx;
+  while (first > 0 && a_sector->sector_idx - first < BUFFER_CACHE_RUN_SECTORS - 1) {
+    struct cached_sector* prev = buffer_cache_lookup(a_cache, first - 1);
+    if (prev == NULL || !cached_sector_flushable(prev)) {
+      break;
+    }
+    first--;
+  }
+  // Gather the run. Sectors being written back can't be pinned or changed, so their data is read without the lock.
+  struct cached_sector* run[BUFFER_CACHE_RUN_SECTORS];
+  block_sector_t cnt = 0;
+  while (cnt < BUFFER_CACHE_RUN_SECTORS) {
+    struct cached_sector* one_sector = buffer_cache_lookup(a_cache, first + cnt);
+    if (one_sector == NULL || !cached_sector_flushable(one_sector)) {
+      break;
+    }
+    one_sector->state = CACHED_SECTOR_WRITING_BACK;
+    one_sector->dirty = false;
+    if (one_sector->queued) {
+      list_remove(&one_sector->dirty_elem);
+      one_sector->queued = false;
+      a_cache->num_dirty--;
+    }
+    run[cnt++] = one_sector;
+  }
+  ASSERT(cnt > 0);
+  bool use_run_buffer = !a_cache->run_buffer_busy && cnt > 1;
+  if (use_run_buffer) {
+    a_cache->run_buffer_busy = true;
+  }
   lock_release(&a_cache->lock);
+  if (use_run_buffer) {
+    for (block_sector_t i = 0; i < cnt; i++) {
+      memcpy(a_cache->run_buffer + i * BLOCK_SECTOR_SIZE, run[i]->data, BLOCK_SECTOR_SIZE);
+    }
+    block_write_multiple(a_cache->block_device, first, cnt, a_cache->run_buffer);
+  } else {
+    for (block_sector_t i = 0; i < cnt; i++) {
+      block_write(a_cache->block_device, first + i, run[i]->data);
+    }
+  }
+  lock_acquire(&a_cache->lock);
+  if (use_run_buffer) {
+    a_cache->run_buffer_busy = false;
+  }
+  a_cache->num_write_back += cnt;
+  a_cache->num_write_cmd += use_run_buffer ? 1 : cnt;
+  for (block_sector_t i = 0; i < cnt; i++) {
+    cached_sector_set_state(a_cache, run[i], CACHED_SECTOR_VALID);
+  }
+}
+
+/*Take a sector of A_CACHE not in use, or else the victim chosen by its replacement policy, drop it from the index if
+  it is in use, and index it as A_SECTOR of class A_CLASS in the LOADING state. While no more than META_RESERVE
+  sectors hold metadata, data only replaces data unless every data sector is busy. The data of the returned sector is not loaded.
+  If the victim is dirty, or every sector is busy, the global lock is released to write the victim back or to wait
+  for a sector, and NULL is returned: A_SECTOR may have been cached meanwhile, so the caller must look it up again.
+  If A_MAY_BLOCK is false, NULL is returned instead, without ever releasing the global lock.*/
+static struct cached_sector* buffer_cache_evict(buffer_cache_t* a_cache, block_sector_t a_sector, enum buffer_cache_class a_class, bool a_may_block) {
+  ASSERT(lock_held_by_current_thread(&a_cache->lock));
+  struct cached_sector* ret;
+  if (!list_empty(&a_cache->free)) {
+    ret = list_entry(list_pop_front(&a_cache->free), struct cached_sector, queue_elem);
+  } else {
+    bool data_only = a_class == BUFFER_CACHE_DATA && a_cache->class_cnt[BUFFER_CACHE_META] <= a_cache->meta_reserve;
+    ret = a_cache->policy->victim(a_cache, a_sector, data_only);
+    if (ret == NULL && data_only) { // borrow from the metadata quota
+      ret = a_cache->policy->victim(a_cache, a_sector, false);
+    }
+    if (ret == NULL) {
+      if (a_may_block) {
+        cond_wait(&a_cache->slot_freed, &a_cache->lock);
+      }
+      return NULL;
+    }
+    if (ret->dirty) {
+      if (a_may_block) {
+        // Write back (if)on eviction
+        cached_sector_flush_run(a_cache, ret);
+      }
+      return NULL;
+    }
+    a_cache->policy->evict(a_cache, ret, a_sector);
+    hash_delete(&a_cache->index, &ret->hash_elem);
+    a_cache->class_cnt[ret->class]--;
+  }
+  ret->sector_idx = a_sector;
+  ret->class = a_class;
+  a_cache->class_cnt[a_class]++;
+  ret->state = CACHED_SECTOR_LOADING;
+  ret->prefetched = false;
+  hash_insert(&a_cache->index, &ret->hash_elem);
+  a_cache->policy->insert(a_cache, ret);
+  return ret;
+}
+
+/*Find the cached buffer from the cache, or cache the sector and then return the cached buffer, evicting any old buffer if necessary.
+  The returned sector is pinned and must be handed back with cached_sector_release().
+  A_LOAD_DATA is set to false ONLY when loading data isn't necessary for the cache to function i.e. exactly one block of data is being written to the cache.
+  In that case a newly cached sector is returned in the LOADING state, and becomes readable once released.
+  The sector is accounted to A_CLASS from now on.*/
+static struct cached_sector* buffer_cache_fetch(buffer_cache_t* a_cache, block_sector_t a_sector, enum buffer_cache_class a_class, bool a_load_data) {
+  struct cached_sector* ret;
+  lock_acquire(&a_cache->lock);
+  for (;;) {
+    // Find
+    ret = buffer_cache_lookup(a_cache, a_sector);
+    if (ret != NULL) {
+      if (cached_sector_in_flight(ret)) {
+        cond_wait(&ret->changed, &a_cache->lock);
+        continue;
+      }
+      a_cache->num_hit++;
+      a_cache->num_class_hit[a_class]++;
+      if (ret->class != a_class) { // the sector was freed and reused
+        a_cache->class_cnt[ret->class]--;
+        a_cache->class_cnt[a_class]++;
+        ret->class = a_class;
+      }
+      // The first access to a prefetched sector is the one its insertion stood for.
+      if (ret->prefetched) {
+        a_cache->num_prefetch_hit++;
+        ret->prefetched = false;
+      } else {
+        a_cache->policy->access(a_cache, ret);
+      }
+      ret->pin_cnt++;
+      break;
+    }
 
+    // Insertion
+    ret = buffer_cache_evict(a_cache, a_sector, a_class, true);
+    if (ret == NULL) {
+      continue;
+    }
+    a_cache->num_miss++;
+    a_cache->num_class_miss[a_class]++;
+    ret->pin_cnt++;
+    // Data fetch, without the global lock; other threads wanting A_SECTOR wait for the LOADING state to end.
+    if (a_load_data) {
+      lock_release(&a_cache->lock);
+      block_read(a_cache->block_device, a_sector, ret->data);
+      lock_acquire(&a_cache->lock);
+      cached_sector_set_state(a_cache, ret, CACHED_SECTOR_VALID);
+    }
+    break;
+  }
+  lock_release(&a_cache->lock);
   return ret;
 }
 
-/* Initialize buffer cache; This function is called only once.*/
-static void buffer_cache_init(buffer_cache_t* a_cache) {
+/*Unpin A_SECTOR, obtained from buffer_cache_fetch(). If A_DIRTIED, mark it dirty and queue it for write-behind.*/
+static void cached_sector_release(buffer_cache_t* a_cache, struct cached_sector* a_sector, bool a_dirtied) {
+  lock_acquire(&a_cache->lock);
+  if (a_dirtied) {
+    a_sector->dirty = true;
+    if (!a_sector->queued) {
+      a_sector->queued = true;
+      a_sector->dirty_since = timer_ticks();
+      list_push_back(&a_cache->dirty, &a_sector->dirty_elem);
+      a_cache->num_dirty++;
+    }
+  }
+  if (a_sector->state == CACHED_SECTOR_LOADING) { // filled by a writer
+    cached_sector_set_state(a_cache, a_sector, CACHED_SECTOR_VALID);
+  }
+  ASSERT(a_sector->pin_cnt > 0);
+  if (--a_sector->pin_cnt == 0) {
+    cond_broadcast(&a_sector->changed, &a_cache->lock);
+    cond_broadcast(&a_cache->slot_freed, &a_cache->lock);
+  }
+  lock_release(&a_cache->lock);
+}
+
+/*Load A_SECTOR into A_CACHE unless it is already cached. Unlike buffer_cache_fetch(), this doesn't count as an access.*/
+static void buffer_cache_prefetch(buffer_cache_t* a_cache, block_sector_t a_sector) {
+  lock_acquire(&a_cache->lock);
+  struct cached_sector* sector = NULL;
+  while (buffer_cache_lookup(a_cache, a_sector) == NULL) {
+    sector = buffer_cache_evict(a_cache, a_sector, BUFFER_CACHE_DATA, true);
+    if (sector != NULL) {
+      break;
+    }
+  }
+  if (sector != NULL) {
+    a_cache->num_prefetch++;
+    lock_release(&a_cache->lock);
+    block_read(a_cache->block_device, a_sector, sector->data);
+    lock_acquire(&a_cache->lock);
+    sector->prefetched = true;
+    cached_sector_set_state(a_cache, sector, CACHED_SECTOR_VALID);
+  }
+  lock_release(&a_cache->lock);
+}
+
+/* Initialize buffer cache; This function is called only once. Return false on memory shortage.*/
+static bool buffer_cache_init(buffer_cache_t* a_cache) {
   lock_init(&a_cache->lock);
-  for (size_t i = 0; i < BUFFER_CACHE_SIZE; i++) {
+  cond_init(&a_cache->slot_freed);
+  a_cache->run_buffer_busy = false;
+  a_cache->num_write_back = 0;
+  a_cache->num_write_cmd = 0;
+  a_cache->flush_write_back = 0;
+  a_cache->flush_write_cmd = 0;
+  a_cache->flush_ticks = 0;
+  if (!hash_init(&a_cache->index, cached_sector_hash, cached_sector_less, NULL)) {
+    return false;
+  }
+  if (!hash_init(&a_cache->ghost_index, cache_ghost_hash, cache_ghost_less, NULL)) {
+    hash_destroy(&a_cache->index, NULL);
+    return false;
+  }
+  a_cache->policy = &buffer_cache_policies[buffer_cache_policy];
+  list_init(&a_cache->free);
+  list_init(&a_cache->ghost_free);
+  for (int i = 0; i < 2; i++) {
+    list_init(&a_cache->resident[i]);
+    a_cache->resident_cnt[i] = 0;
+    list_init(&a_cache->ghost[i]);
+    a_cache->ghost_cnt[i] = 0;
+  }
+  a_cache->clock_hand = 0;
+  a_cache->arc_target = 0;
+  list_init(&a_cache->dirty);
+  a_cache->num_dirty = 0;
+  a_cache->dirty_limit = buffer_cache_dirty_limit != 0 ? buffer_cache_dirty_limit : a_cache->size / 2;
+  a_cache->meta_reserve = buffer_cache_meta_reserve != 0 ? buffer_cache_meta_reserve : a_cache->size / 4;
+  a_cache->num_hit = 0;
+  a_cache->num_miss = 0;
+  a_cache->num_prefetch = 0;
+  a_cache->num_prefetch_hit = 0;
+  for (int i = 0; i < 2; i++) {
+    a_cache->num_class_hit[i] = 0;
+    a_cache->num_class_miss[i] = 0;
+    a_cache->class_cnt[i] = 0;
+  }
+  lock_init(&a_cache->ra_lock);
+  sema_init(&a_cache->ra_pending, 0);
+  a_cache->ra_head = 0;
+  a_cache->ra_count = 0;
+  for (size_t i = 0; i < a_cache->size; i++) {
     struct cached_sector* one_sector = a_cache->sectors + i;
     one_sector->sector_idx = -1;
+    one_sector->state = CACHED_SECTOR_EMPTY;
+    one_sector->pin_cnt = 0;
     one_sector->dirty = false;
-    one_sector->last_accessed = INT64_MIN; // INT64_MIN means the sector is not in use.
-    a_cache->num_hit = 0;
-    a_cache->num_miss = 0;
-    rwLock_init(&one_sector->lock);
+    one_sector->prefetched = false;
+    one_sector->queued = false;
+    one_sector->write_locked = false;
+    one_sector->class = BUFFER_CACHE_DATA;
+    one_sector->queue = -1;
+    one_sector->referenced = false;
+    one_sector->data = a_cache->data + i * BLOCK_SECTOR_SIZE;
+    cond_init(&one_sector->changed);
+    rw_lock_init(&one_sector->lock);
+    list_push_back(&a_cache->free, &one_sector->queue_elem);
+    a_cache->ghosts[i].list = -1;
+    list_push_back(&a_cache->ghost_free, &a_cache->ghosts[i].elem);
   }
+  return true;
 }
 
-/* Write A_SIZE bytes from A_SRC to the block A_DEST, starting at A_DEST, through buffer cache.*/
-void buffer_cache_write(buffer_cache_t* a_cache, block_sector_t a_dest, void* a_src, int a_offset, int a_size) {
+/* Write A_SIZE bytes from A_SRC to the block A_DEST, starting at A_DEST, through buffer cache. A_CLASS tells what the block holds.*/
+void buffer_cache_write(buffer_cache_t* a_cache, block_sector_t a_dest, void* a_src, int a_offset, int a_size, enum buffer_cache_class a_class) {
   ASSERT(a_dest != -1);
   bool load_data = a_offset != 0 || a_size != BLOCK_SECTOR_SIZE; // avoid unnecessary disk access for write
-  struct cached_sector* sector = buffer_cache_fetch(a_cache, a_dest, load_data);
-  wLock_acquire(&sector->lock);
+  struct cached_sector* sector = buffer_cache_fetch(a_cache, a_dest, a_class, load_data);
+  rw_lock_acquire(&sector->lock, RW_WRITER);
   memcpy(sector->data + a_offset, a_src, a_size);
-  sector->dirty = true;
-  wLock_release(&sector->lock);
+  rw_lock_release(&sector->lock, RW_WRITER);
+  cached_sector_release(a_cache, sector, true);
 }
 
-/* Read A_SIZE bytes from the block A_SRC, starting at A_OFFSET, into A_DEST, through buffer cache.*/
-void buffer_cache_read(buffer_cache_t* a_cache, block_sector_t a_src, void* a_dest, int a_offset, int a_size) {
+/* Read A_SIZE bytes from the block A_SRC, starting at A_OFFSET, into A_DEST, through buffer cache. A_CLASS tells what the block holds.*/
+void buffer_cache_read(buffer_cache_t* a_cache, block_sector_t a_src, void* a_dest, int a_offset, int a_size, enum buffer_cache_class a_class) {
   ASSERT(a_src != -1);
-  struct cached_sector* sector = buffer_cache_fetch(a_cache, a_src, true);
-  rLock_acquire(&sector->lock);
+  struct cached_sector* sector = buffer_cache_fetch(a_cache, a_src, a_class, true);
+  rw_lock_acquire(&sector->lock, RW_READER);
   memcpy(a_dest, sector->data + a_offset, a_size);
-  rLock_release(&sector->lock);
+  rw_lock_release(&sector->lock, RW_READER);
+  cached_sector_release(a_cache, sector, false);
+}
+
+/* Pin A_SECTOR in A_CACHE and return its cached data, so that it can be accessed in place without copying. The sector
+  can't be evicted and is locked for reading, or for writing if A_WRITE, until it is handed back with
+  buffer_cache_put(). Pins should be short: a thread must not sleep on anything else while holding one.
+  A_CLASS tells what the sector holds.*/
+void* buffer_cache_get(buffer_cache_t* a_cache, block_sector_t a_sector, bool a_write, enum buffer_cache_class a_class) {
+  ASSERT(a_sector != -1);
+  struct cached_sector* sector = buffer_cache_fetch(a_cache, a_sector, a_class, true);
+  rw_lock_acquire(&sector->lock, !a_write);
+  if (a_write) {
+    sector->write_locked = true;
+  }
+  return sector->data;
+}
+
+/* Unpin the sector whose data A_DATA was returned by buffer_cache_get(). A_DIRTY tells whether the data was modified,
+  which requires the sector to have been pinned for writing.*/
+void buffer_cache_put(buffer_cache_t* a_cache, const void* a_data, bool a_dirty) {
+  struct cached_sector* sector = a_cache->sectors + ((const uint8_t*)a_data - a_cache->data) / BLOCK_SECTOR_SIZE;
+  ASSERT(sector->data == a_data);
+  ASSERT(!a_dirty || sector->write_locked);
+  bool write_locked = sector->write_locked;
+  if (write_locked) {
+    sector->write_locked = false;
+  }
+  rw_lock_release(&sector->lock, !write_locked);
+  cached_sector_release(a_cache, sector, a_dirty);
 }
 
-/*Flush all dirty blocks in the buffer cache.*/
+/* Read A_CNT whole sectors starting at A_SRC into A_DEST through buffer cache. Runs of sectors that are not cached are
+  read from disk with a single command each, up to BUFFER_CACHE_RUN_SECTORS at a time, through the run buffer when it
+  is free, then cached as A_CLASS.*/
+void buffer_cache_read_multiple(buffer_cache_t* a_cache, block_sector_t a_src, block_sector_t a_cnt, void* a_dest, enum buffer_cache_class a_class) {
+  ASSERT(a_src != -1);
+  uint8_t* dest = a_dest;
+  lock_acquire(&a_cache->lock);
+  block_sector_t i = 0;
+  while (i < a_cnt) {
+    struct cached_sector* sector = buffer_cache_lookup(a_cache, a_src + i);
+    if (sector != NULL) {
+      lock_release(&a_cache->lock);
+      buffer_cache_read(a_cache, a_src + i, dest + i * BLOCK_SECTOR_SIZE, 0, BLOCK_SECTOR_SIZE, a_class);
+      lock_acquire(&a_cache->lock);
+      i++;
+      continue;
+    }
+    // Claim the whole run of uncached sectors, read it at once, then fill the claimed sectors.
+    struct cached_sector* run[BUFFER_CACHE_RUN_SECTORS];
+    run[0] = buffer_cache_evict(a_cache, a_src + i, a_class, true);
+    if (run[0] == NULL) {
+      continue;
+    }
+    block_sector_t cnt = 1;
+    while (cnt < BUFFER_CACHE_RUN_SECTORS && i + cnt < a_cnt && buffer_cache_lookup(a_cache, a_src + i + cnt) == NULL) {
+      run[cnt] = buffer_cache_evict(a_cache, a_src + i + cnt, a_class, false);
+      if (run[cnt] == NULL) {
+        break;
+      }
+      cnt++;
+    }
+    a_cache->num_miss += cnt;
+    a_cache->num_class_miss[a_class] += cnt;
+    bool use_run_buffer = !a_cache->run_buffer_busy && cnt > 1;
+    if (use_run_buffer) {
+      a_cache->run_buffer_busy = true;
+    }
+    lock_release(&a_cache->lock);
+    // The run is read into kernel memory only: A_DEST may be a user buffer that changes under us, and what lands in
+    // the claimed sectors is shared with every other reader.
+    if (use_run_buffer) {
+      block_read_multiple(a_cache->block_device, a_src + i, cnt, a_cache->run_buffer);
+      for (block_sector_t k = 0; k < cnt; k++) {
+        memcpy(run[k]->data, a_cache->run_buffer + k * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+      }
+    } else {
+      for (block_sector_t k = 0; k < cnt; k++) {
+        block_read(a_cache->block_device, a_src + i + k, run[k]->data);
+      }
+    }
+    // The claimed sectors are still LOADING, so nobody else touches their data while it is copied out.
+    for (block_sector_t k = 0; k < cnt; k++) {
+      memcpy(dest + (i + k) * BLOCK_SECTOR_SIZE, run[k]->data, BLOCK_SECTOR_SIZE);
+    }
+    lock_acquire(&a_cache->lock);
+    if (use_run_buffer) {
+      a_cache->run_buffer_busy = false;
+    }
+    for (block_sector_t k = 0; k < cnt; k++) {
+      cached_sector_set_state(a_cache, run[k], CACHED_SECTOR_VALID);
+    }
+    i += cnt;
+  }
+  lock_release(&a_cache->lock);
+}
+
+/*Order pointers to cached_sectors by sector number, for qsort().*/
+static int cached_sector_compare(const void* a_a, const void* a_b) {
+  block_sector_t a = (*(struct cached_sector* const*)a_a)->sector_idx;
+  block_sector_t b = (*(struct cached_sector* const*)a_b)->sector_idx;
+  return a < b ? -1 : a > b;
+}
+
+/*Flush all dirty blocks in the buffer cache. Dirty sectors are written back in ascending sector order, so that the
+  disk head sweeps once across the disk and adjacent sectors are merged into one command each.
+  The cost of the flush is kept for buffer_cache_print_stats().*/
 void buffer_cache_flush(buffer_cache_t* a_cache) {
+  int64_t start = timer_ticks();
+  struct cached_sector** dirty = malloc(a_cache->size * sizeof *dirty);
   lock_acquire(&a_cache->lock);
-  // no lock is needed for the list since all elements have their own locks.
-  for (int i = 0; i < BUFFER_CACHE_SIZE; i++) {
-    struct cached_sector* one_sector = a_cache->sectors + i;
-    cached_sector_flush(a_cache, one_sector);
+  int num_write_back = a_cache->num_write_back;
+  int num_write_cmd = a_cache->num_write_cmd;
+  size_t dirty_cnt = 0;
+  if (dirty != NULL) {
+    for (size_t i = 0; i < a_cache->size; i++) {
+      if (a_cache->sectors[i].sector_idx != -1 && a_cache->sectors[i].dirty) {
+        dirty[dirty_cnt++] = a_cache->sectors + i;
+      }
+    }
+    qsort(dirty, dirty_cnt, sizeof *dirty, cached_sector_compare);
+    // each run starts at its lowest sector, since the ones below it were flushed before.
+    for (size_t i = 0; i < dirty_cnt; i++) {
+      cached_sector_flush_run(a_cache, dirty[i]);
+    }
+  }
+  // memory shortage, or sectors dirtied meanwhile
+  for (size_t i = 0; i < a_cache->size; i++) {
+    cached_sector_flush_run(a_cache, a_cache->sectors + i);
   }
+  a_cache->flush_write_back = a_cache->num_write_back - num_write_back;
+  a_cache->flush_write_cmd = a_cache->num_write_cmd - num_write_cmd;
+  a_cache->flush_ticks = timer_elapsed(start);
   lock_release(&a_cache->lock);
+  free(dirty);
 }
 
 /*Reset all cache as cold and flush unflushed writes.*/
 void buffer_cache_reset(buffer_cache_t* a_cache) {
+  buffer_cache_flush(a_cache);
   lock_acquire(&a_cache->lock);
-  for (int i = 0; i < BUFFER_CACHE_SIZE; i++) {
+  for (size_t i = 0; i < a_cache->size; i++) {
     struct cached_sector* one_sector = a_cache->sectors + i;
-    cached_sector_flush(a_cache, one_sector);
+    // flushing drops the global lock, so check again until the sector is idle and clean.
+    while (one_sector->sector_idx != -1 && (one_sector->dirty || one_sector->pin_cnt > 0 || cached_sector_in_flight(one_sector))) {
+      cached_sector_flush_run(a_cache, one_sector);
+    }
+    if (one_sector->sector_idx != -1) {
+      hash_delete(&a_cache->index, &one_sector->hash_elem);
+      cached_sector_dequeue(a_cache, one_sector);
+      a_cache->class_cnt[one_sector->class]--;
+      list_push_back(&a_cache->free, &one_sector->queue_elem);
+    }
     one_sector->sector_idx = -1;
-    one_sector->dirty = false;
-    one_sector->last_accessed = INT64_MIN;
+    one_sector->state = CACHED_SECTOR_EMPTY;
+    one_sector->prefetched = false;
   }
+  buffer_cache_clear_ghosts(a_cache);
+  a_cache->arc_target = 0;
   a_cache->num_hit = 0;
   a_cache->num_miss = 0;
+  a_cache->num_prefetch = 0;
+  a_cache->num_prefetch_hit = 0;
+  for (int i = 0; i < 2; i++) {
+    a_cache->num_class_hit[i] = 0;
+    a_cache->num_class_miss[i] = 0;
+  }
   lock_release(&a_cache->lock);
 }
 
@@ -158,15 +903,137 @@ int buffer_cache_get_miss_time(buffer_cache_t* a_cache) {
   lock_release(&a_cache->lock);
   return ret;
 }
+int buffer_cache_get_prefetch_time(buffer_cache_t* a_cache) {
+  lock_acquire(&a_cache->lock);
+  int ret = a_cache->num_prefetch;
+  lock_release(&a_cache->lock);
+  return ret;
+}
+int buffer_cache_get_prefetch_hit_time(buffer_cache_t* a_cache) {
+  lock_acquire(&a_cache->lock);
+  int ret = a_cache->num_prefetch_hit;
+  lock_release(&a_cache->lock);
+  return ret;
+}
+/* Store the number of hits and misses of A_CACHE on sectors of class A_CLASS into *A_HIT and *A_MISS.*/
+void buffer_cache_get_class_stats(buffer_cache_t* a_cache, enum buffer_cache_class a_class, int* a_hit, int* a_miss) {
+  lock_acquire(&a_cache->lock);
+  *a_hit = a_cache->num_class_hit[a_class];
+  *a_miss = a_cache->num_class_miss[a_class];
+  lock_release(&a_cache->lock);
+}
+/* Return the number of sectors A_CACHE can hold; fixed at creation.*/
+int buffer_cache_get_size(buffer_cache_t* a_cache) {
+  return a_cache->size;
+}
+
+/* Prints the cost of the last flush of A_CACHE, normally the one done at shutdown. Ignores a null A_CACHE.*/
+void buffer_cache_print_stats(buffer_cache_t* a_cache) {
+  if (a_cache == NULL) {
+    return;
+  }
+  printf("Buffer cache: flushed %d sectors with %d writes in %" PRId64 " ticks\n", a_cache->flush_write_back,
+         a_cache->flush_write_cmd, a_cache->flush_ticks);
+}
 
-/* Dynamically allocate space for a new buffer cache designated for A_BLOCK_DEVICE.*/
+/*Write back the sectors that have been dirty for longer than buffer_cache_dirty_age ticks, oldest first, and then
+  keep writing back until at most DIRTY_LIMIT sectors are dirty. The global lock is dropped during each write so
+  that cache hits are not held up by the whole pass.*/
+static void buffer_cache_write_behind(buffer_cache_t* a_cache) {
+  lock_acquire(&a_cache->lock);
+  while (!list_empty(&a_cache->dirty)) {
+    struct cached_sector* oldest = list_entry(list_front(&a_cache->dirty), struct cached_sector, dirty_elem);
+    if (a_cache->num_dirty <= a_cache->dirty_limit && timer_elapsed(oldest->dirty_since) < buffer_cache_dirty_age) {
+      break;
+    }
+    cached_sector_flush_run(a_cache, oldest);
+  }
+  lock_release(&a_cache->lock);
+}
+
+/*Body of the write-behind flusher thread of the buffer cache A_CACHE. Never returns.*/
+static void buffer_cache_flusher(void* a_cache) {
+  for (;;) {
+    timer_sleep(BUFFER_CACHE_FLUSH_INTERVAL);
+    // the free map is written lazily; push its changes into the cache so they age like any other write.
+    free_map_sync();
+    buffer_cache_write_behind(a_cache);
+  }
+}
+
+/*Start the write-behind flusher thread of A_CACHE, so that evictions mostly find clean sectors and dirty data does
+  not stay in memory indefinitely. Return false if the thread cannot be created.*/
+bool buffer_cache_start_flusher(buffer_cache_t* a_cache) {
+  return thread_create("bcache-flush", PRI_DEFAULT, buffer_cache_flusher, a_cache) != TID_ERROR;
+}
+
+/*Ask the read-ahead worker of A_CACHE to load A_SECTOR in the background. Read-ahead is only a hint: the request is
+  dropped if the queue is full.*/
+void buffer_cache_read_ahead(buffer_cache_t* a_cache, block_sector_t a_sector) {
+  ASSERT(a_sector != -1);
+  lock_acquire(&a_cache->ra_lock);
+  bool queued = a_cache->ra_count < BUFFER_CACHE_READ_AHEAD_QUEUE;
+  if (queued) {
+    a_cache->ra_queue[(a_cache->ra_head + a_cache->ra_count) % BUFFER_CACHE_READ_AHEAD_QUEUE] = a_sector;
+    a_cache->ra_count++;
+  }
+  lock_release(&a_cache->ra_lock);
+  if (queued) {
+    sema_up(&a_cache->ra_pending);
+  }
+}
+
+/*Body of the read-ahead worker thread of the buffer cache A_CACHE. Never returns.*/
+static void buffer_cache_read_ahead_worker(void* a_cache_) {
+  buffer_cache_t* a_cache = a_cache_;
+  for (;;) {
+    sema_down(&a_cache->ra_pending);
+    lock_acquire(&a_cache->ra_lock);
+    block_sector_t sector = a_cache->ra_queue[a_cache->ra_head];
+    a_cache->ra_head = (a_cache->ra_head + 1) % BUFFER_CACHE_READ_AHEAD_QUEUE;
+    a_cache->ra_count--;
+    lock_release(&a_cache->ra_lock);
+    buffer_cache_prefetch(a_cache, sector);
+  }
+}
+
+/*Start the read-ahead worker thread of A_CACHE. Return false if the thread cannot be created.*/
+bool buffer_cache_start_read_ahead(buffer_cache_t* a_cache) {
+  return thread_create("bcache-ra", PRI_DEFAULT, buffer_cache_read_ahead_worker, a_cache) != TID_ERROR;
+}
+
+/* Dynamically allocate space for a new buffer cache designated for A_BLOCK_DEVICE, holding buffer_cache_size sectors.
+  Sector data and bookkeeping are backed by whole pages so that the cache can grow to several MiB.*/
 buffer_cache_t* buffer_cache_create(struct block* a_block_device) {
+  ASSERT(buffer_cache_size > 0);
   buffer_cache_t* ret = malloc(sizeof(buffer_cache_t));
   if (!ret) {
     return NULL;
   }
   ret->block_device = a_block_device;
-  buffer_cache_init(ret);
+  ret->size = buffer_cache_size;
+  ret->sectors_pages = DIV_ROUND_UP(ret->size * sizeof(struct cached_sector), PGSIZE);
+  ret->data_pages = DIV_ROUND_UP(ret->size * BLOCK_SECTOR_SIZE, PGSIZE);
+  ret->ghosts_pages = DIV_ROUND_UP(ret->size * sizeof(struct cache_ghost), PGSIZE);
+  ret->sectors = palloc_get_multiple(0, ret->sectors_pages);
+  ret->data = palloc_get_multiple(0, ret->data_pages);
+  ret->ghosts = palloc_get_multiple(0, ret->ghosts_pages);
+  ret->run_buffer = palloc_get_page(0);
+  if (ret->sectors == NULL || ret->data == NULL || ret->ghosts == NULL || ret->run_buffer == NULL || !buffer_cache_init(ret)) {
+    if (ret->ghosts != NULL) {
+      palloc_free_multiple(ret->ghosts, ret->ghosts_pages);
+    }
+    if (ret->run_buffer != NULL) {
+      palloc_free_page(ret->run_buffer);
+    }
+    if (ret->sectors != NULL) {
+      palloc_free_multiple(ret->sectors, ret->sectors_pages);
+    }
+    if (ret->data != NULL) {
+      palloc_free_multiple(ret->data, ret->data_pages);
+    }
+    free(ret);
+    return NULL;
+  }
   return ret;
-}
-
+}
\ No newline at end of file
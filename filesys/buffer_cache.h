@@ -1,9 +1,45 @@
+#ifndef FILESYS_BUFFER_CACHE_H
+#define FILESYS_BUFFER_CACHE_H
+
+#include <stdbool.h>
 #include "devices/block.h"
+#include "devices/timer.h"
 
 #define ENABLE_BUFFER_CACHE 1
 
 
-#define BUFFER_CACHE_SIZE 64 /*Maximum number of sectors to be cached. */
+#define BUFFER_CACHE_DEFAULT_SIZE 64 /*Number of sectors cached unless overridden by "-bcache=N". */
+
+#define BUFFER_CACHE_DEFAULT_DIRTY_AGE TIMER_FREQ /*Ticks a sector may stay dirty before the flusher writes it back. */
+#define BUFFER_CACHE_FLUSH_INTERVAL (TIMER_FREQ / 10) /*Ticks between two passes of the write-behind flusher. */
+#define BUFFER_CACHE_READ_AHEAD_QUEUE 64 /*Maximum number of sectors waiting to be prefetched. */
+
+/*Replacement policies of the buffer cache.*/
+enum buffer_cache_policy_type {
+  BUFFER_CACHE_POLICY_LRU,   /* Least recently used. */
+  BUFFER_CACHE_POLICY_CLOCK, /* Second chance. */
+  BUFFER_CACHE_POLICY_2Q,    /* Probation FIFO, ghost queue, and LRU of re-referenced sectors. */
+  BUFFER_CACHE_POLICY_ARC    /* Adaptive replacement cache. */
+};
+
+/*What a cached sector holds. Inodes, indirect blocks, directories and the free map are metadata, which a stream
+  of file data must not push out of the cache.*/
+enum buffer_cache_class {
+  BUFFER_CACHE_DATA,
+  BUFFER_CACHE_META
+};
+
+/*Number of sectors to be cached by caches created from now on. Set from the kernel command line.*/
+extern size_t buffer_cache_size;
+/*Write-behind thresholds, set from the kernel command line. A dirty sector is written back once it has been dirty for
+  buffer_cache_dirty_age ticks, or as soon as more than buffer_cache_dirty_limit sectors are dirty; a limit of 0 means half of the cache.*/
+extern int64_t buffer_cache_dirty_age;
+extern size_t buffer_cache_dirty_limit;
+/*Replacement policy of caches created from now on. Set from the kernel command line.*/
+extern enum buffer_cache_policy_type buffer_cache_policy;
+/*Number of metadata sectors kept from being evicted to make room for file data, unless every other sector is busy;
+  0 means a quarter of the cache. Set from the kernel command line.*/
+extern size_t buffer_cache_meta_reserve;
 
 struct buffer_cache;
 
@@ -13,8 +49,21 @@ void buffer_cache_flush(buffer_cache_t* a_cache);
 void buffer_cache_reset(buffer_cache_t* a_cache);
 int buffer_cache_get_hit_time(buffer_cache_t* a_cache);
 int buffer_cache_get_miss_time(buffer_cache_t* a_cache);
+int buffer_cache_get_size(buffer_cache_t* a_cache);
+void buffer_cache_print_stats(buffer_cache_t* a_cache);
+int buffer_cache_get_prefetch_time(buffer_cache_t* a_cache);
+int buffer_cache_get_prefetch_hit_time(buffer_cache_t* a_cache);
+void buffer_cache_get_class_stats(buffer_cache_t* a_cache, enum buffer_cache_class a_class, int* a_hit, int* a_miss);
+
+void buffer_cache_read(buffer_cache_t* a_cache, block_sector_t a_src, void* a_dest, int a_offset, int a_size, enum buffer_cache_class a_class);
+void buffer_cache_write(buffer_cache_t* a_cache, block_sector_t a_dest, void* a_src, int a_offset, int a_size, enum buffer_cache_class a_class);
+void* buffer_cache_get(buffer_cache_t* a_cache, block_sector_t a_sector, bool a_write, enum buffer_cache_class a_class);
+void buffer_cache_put(buffer_cache_t* a_cache, const void* a_data, bool a_dirty);
+void buffer_cache_read_multiple(buffer_cache_t* a_cache, block_sector_t a_src, block_sector_t a_cnt, void* a_dest, enum buffer_cache_class a_class);
+void buffer_cache_read_ahead(buffer_cache_t* a_cache, block_sector_t a_sector);
 
-void buffer_cache_read(buffer_cache_t* a_cache, block_sector_t a_src, void* a_dest, int a_offset, int a_size);
-void buffer_cache_write(buffer_cache_t* a_cache, block_sector_t a_dest, void* a_src, int a_offset, int a_size);
+buffer_cache_t* buffer_cache_create(struct block* a_block_device);
+bool buffer_cache_start_flusher(buffer_cache_t* a_cache);
+bool buffer_cache_start_read_ahead(buffer_cache_t* a_cache);
 
-buffer_cache_t* buffer_cache_create(struct block* a_block_device);
\ No newline at end of file
+#endif /* filesys/buffer_cache.h */
@@ -1,10 +1,13 @@
 #include "filesys/directory.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "lib/utils.h"
 
 static const char name_cwd[2] = {'.', '\0'};
@@ -25,11 +28,232 @@ struct dir_entry {
   bool in_use;                 /* In use or free? */
 };
 
+/* Hashed directories (see inode_is_hashed()) are an array of
+   buckets, one sector each, whose number is a power of 2.  An
+   entry lives in the bucket selected by the low bits of the hash
+   of its name, so looking a name up usually reads a single
+   sector.  When the bucket of a new entry is full, the number of
+   buckets is doubled and each bucket moves the entries that now
+   hash elsewhere to its new twin.  If doubling would not separate
+   the entries of the full bucket, the new entry overflows into
+   the next bucket with room instead, and every bucket it passes
+   is flagged so that lookups keep probing past it.  The number of
+   buckets is kept in bucket 0, so that a split only takes effect
+   once it is complete. */
+#define DIR_BUCKET_ENTRIES (BLOCK_SECTOR_SIZE / sizeof(struct dir_entry)) // 512 bytes / 20 bytes = 25 entries
+#define DIR_MAX_BUCKETS 16384 // 8 MiB, hundreds of thousands of entries
+
+/* A bucket of a hashed directory. */
+struct dir_bucket {
+  struct dir_entry entries[DIR_BUCKET_ENTRIES];
+  uint32_t bucket_cnt; /* Number of buckets, in bucket 0 only. */
+  bool overflow;       /* Has an entry that hashes here or earlier been put past this bucket? */
+  char padding[BLOCK_SECTOR_SIZE - DIR_BUCKET_ENTRIES * sizeof(struct dir_entry) - sizeof(uint32_t) - sizeof(bool)];
+};
+
+/* Directory entry cache.  Maps a (directory sector, name) pair
+   to the sector of the inode the name refers to, or to -1 if the
+   directory has no such entry, so that resolving a path that was
+   resolved recently takes one hash lookup per component instead
+   of opening and reading each directory.  An entry is dropped
+   whenever the name is added to or removed from its directory,
+   and every entry of a directory is dropped when the directory
+   itself is removed, since its sector may be reused. */
+#define DIR_CACHE_SIZE 256
+
+struct dir_cache_entry {
+  block_sector_t parent;       /* Sector of the directory. */
+  char name[NAME_MAX + 1];     /* Null terminated file name. */
+  block_sector_t inode_sector; /* Sector of the named inode, or -1 if none. */
+  bool is_dir;                 /* Does INODE_SECTOR hold a directory? */
+  struct hash_elem hash_elem;  /* Element in dir_cache. */
+  struct list_elem lru_elem;   /* Element in dir_cache_lru or dir_cache_free. */
+};
+
+static struct hash dir_cache;
+static struct list dir_cache_lru;  /* Entries in dir_cache, least recently used first. */
+static struct list dir_cache_free; /* Unused entries. */
+static struct lock dir_cache_lock;
+
+static unsigned dir_cache_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct dir_cache_entry* ce = hash_entry(e, struct dir_cache_entry, hash_elem);
+  return hash_string(ce->name) ^ hash_int(ce->parent);
+}
+
+static bool dir_cache_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  const struct dir_cache_entry* ca = hash_entry(a, struct dir_cache_entry, hash_elem);
+  const struct dir_cache_entry* cb = hash_entry(b, struct dir_cache_entry, hash_elem);
+  if (ca->parent != cb->parent)
+    return ca->parent < cb->parent;
+  return strcmp(ca->name, cb->name) < 0;
+}
+
+/* Initializes the directory entry cache.  If memory is short,
+   the cache stays empty and every lookup reads the directory. */
+void dir_init(void) {
+  lock_init(&dir_cache_lock);
+  list_init(&dir_cache_lru);
+  list_init(&dir_cache_free);
+  struct dir_cache_entry* entries = malloc(DIR_CACHE_SIZE * sizeof *entries);
+  if (entries == NULL || !hash_init(&dir_cache, dir_cache_hash, dir_cache_less, NULL)) {
+    free(entries);
+    return;
+  }
+  for (size_t i = 0; i < DIR_CACHE_SIZE; i++)
+    list_push_back(&dir_cache_free, &entries[i].lru_elem);
+}
+
+/* Returns the cached entry for NAME in the directory at sector
+   PARENT, or a null pointer.  The caller must hold
+   dir_cache_lock. */
+static struct dir_cache_entry* dir_cache_find(block_sector_t parent, const char* name) {
+  struct dir_cache_entry key;
+  if (list_empty(&dir_cache_lru))
+    return NULL;
+  key.parent = parent;
+  strlcpy(key.name, name, sizeof key.name);
+  struct hash_elem* e = hash_find(&dir_cache, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct dir_cache_entry, hash_elem) : NULL;
+}
+
+/* Drops CE from the cache.  The caller must hold
+   dir_cache_lock. */
+static void dir_cache_drop(struct dir_cache_entry* ce) {
+  hash_delete(&dir_cache, &ce->hash_elem);
+  list_remove(&ce->lru_elem);
+  list_push_back(&dir_cache_free, &ce->lru_elem);
+}
+
+/* Records that NAME in the directory at sector PARENT refers to
+   INODE_SECTOR, or to nothing if INODE_SECTOR is -1. */
+static void dir_cache_insert(block_sector_t parent, const char* name, block_sector_t inode_sector, bool is_dir) {
+  lock_acquire(&dir_cache_lock);
+  struct dir_cache_entry* ce = dir_cache_find(parent, name);
+  if (ce != NULL)
+    dir_cache_drop(ce);
+  if (list_empty(&dir_cache_free) && !list_empty(&dir_cache_lru))
+    dir_cache_drop(list_entry(list_front(&dir_cache_lru), struct dir_cache_entry, lru_elem));
+  if (!list_empty(&dir_cache_free)) {
+    ce = list_entry(list_pop_front(&dir_cache_free), struct dir_cache_entry, lru_elem);
+    ce->parent = parent;
+    strlcpy(ce->name, name, sizeof ce->name);
+    ce->inode_sector = inode_sector;
+    ce->is_dir = is_dir;
+    hash_insert(&dir_cache, &ce->hash_elem);
+    list_push_back(&dir_cache_lru, &ce->lru_elem);
+  }
+  lock_release(&dir_cache_lock);
+}
+
+/* Forgets what NAME in the directory at sector PARENT refers to. */
+static void dir_cache_invalidate(block_sector_t parent, const char* name) {
+  lock_acquire(&dir_cache_lock);
+  struct dir_cache_entry* ce = dir_cache_find(parent, name);
+  if (ce != NULL)
+    dir_cache_drop(ce);
+  lock_release(&dir_cache_lock);
+}
+
+/* Forgets every entry of the directory at sector PARENT. */
+static void dir_cache_invalidate_dir(block_sector_t parent) {
+  lock_acquire(&dir_cache_lock);
+  struct list_elem* e = list_begin(&dir_cache_lru);
+  while (e != list_end(&dir_cache_lru)) {
+    struct dir_cache_entry* ce = list_entry(e, struct dir_cache_entry, lru_elem);
+    e = list_next(e);
+    if (ce->parent == parent)
+      dir_cache_drop(ce);
+  }
+  lock_release(&dir_cache_lock);
+}
+
+/* Returns the number of buckets of the hashed directory DIR, or 0
+   if bucket 0 cannot be read. */
+static size_t dir_bucket_cnt(const struct dir* dir) {
+  const struct dir_bucket* b = inode_get_block(dir->inode, 0);
+  size_t bucket_cnt = 0;
+  if (b != NULL) {
+    bucket_cnt = b->bucket_cnt;
+    inode_put_block(b);
+  }
+  return bucket_cnt;
+}
+
+/* Returns the bucket NAME belongs to in a hashed directory with BUCKET_CNT buckets. */
+static size_t dir_bucket_of(const char* name, size_t bucket_cnt) {
+  return hash_string(name) & (bucket_cnt - 1);
+}
+
+/* Returns the bucket probed after IDX in a hashed directory with BUCKET_CNT buckets. */
+static size_t dir_next_bucket(size_t idx, size_t bucket_cnt) {
+  return (idx + 1) & (bucket_cnt - 1);
+}
+
+/* Returns true if the entry named NAME, kept in bucket IDX of a
+   hashed directory with BUCKET_CNT buckets, moves to bucket IDX +
+   BUCKET_CNT when the directory splits.  An entry that overflowed
+   past the last bucket back to the first ones moves when its new
+   hash bit is clear rather than set, so that the buckets between
+   its new home and its new place are the flagged twins of the
+   ones it passed before. */
+static bool dir_split_moves(const char* name, size_t idx, size_t bucket_cnt) {
+  bool wrapped = idx < dir_bucket_of(name, bucket_cnt);
+  return ((hash_string(name) & bucket_cnt) != 0) != wrapped;
+}
+
+/* Reads bucket IDX of the hashed directory DIR into B. */
+static bool dir_read_bucket(const struct dir* dir, size_t idx, struct dir_bucket* b) {
+  return inode_read_at(dir->inode, b, sizeof *b, idx * BLOCK_SECTOR_SIZE) == sizeof *b;
+}
+
+/* Writes B to bucket IDX of the hashed directory DIR. */
+static bool dir_write_bucket(struct dir* dir, size_t idx, const struct dir_bucket* b) {
+  return inode_write_at(dir->inode, b, sizeof *b, idx * BLOCK_SECTOR_SIZE) == sizeof *b;
+}
+
+/* Flags bucket IDX of the hashed directory DIR as overflowed. */
+static bool dir_set_overflow(struct dir* dir, size_t idx) {
+  bool overflow = true;
+  return inode_write_at(dir->inode, &overflow, sizeof overflow, idx * BLOCK_SECTOR_SIZE + offsetof(struct dir_bucket, overflow)) == sizeof overflow;
+}
+
+/* Returns the offset of the entry that follows the one at OFS in
+   a hashed directory, skipping the unused tail of each bucket. */
+static off_t dir_bucket_next_ofs(off_t ofs) {
+  ofs += sizeof(struct dir_entry);
+  if (ofs % BLOCK_SECTOR_SIZE > (off_t)((DIR_BUCKET_ENTRIES - 1) * sizeof(struct dir_entry)))
+    ofs = DIV_ROUND_UP(ofs, BLOCK_SECTOR_SIZE) * BLOCK_SECTOR_SIZE;
+  return ofs;
+}
+
+/* Returns the offset of the entry that follows the one at OFS in
+   DIR.  Hashed directories skip the unused tail of each bucket. */
+static off_t dir_next_ofs(const struct dir* dir, off_t ofs) {
+  if (!inode_is_hashed(dir->inode))
+    return ofs + sizeof(struct dir_entry);
+  ofs = dir_bucket_next_ofs(ofs);
+  /* Sectors past the last bucket are left over from a split that failed. */
+  if (ofs % BLOCK_SECTOR_SIZE == 0 && ofs >= (off_t)(dir_bucket_cnt(dir) * BLOCK_SECTOR_SIZE))
+    ofs = inode_length(dir->inode);
+  return ofs;
+}
+
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* Creates a hashed directory with space for about ENTRY_CNT
+   entries in the given SECTOR.  Returns true if successful, false
+   on failure. */
 bool dir_create(block_sector_t sector, size_t entry_cnt) {
-  return inode_create(sector, entry_cnt * sizeof(struct dir_entry), true);
+  size_t bucket_cnt = 1;
+  while (bucket_cnt * DIR_BUCKET_ENTRIES < entry_cnt)
+    bucket_cnt *= 2;
+  if (!inode_create(sector, bucket_cnt * BLOCK_SECTOR_SIZE, true, true))
+    return false;
+
+  struct inode* inode = inode_open(sector);
+  uint32_t cnt = bucket_cnt;
+  bool success = inode != NULL && inode_write_at(inode, &cnt, sizeof cnt, offsetof(struct dir_bucket, bucket_cnt)) == sizeof cnt;
+  inode_close(inode);
+  return success;
 }
 
 
@@ -80,7 +304,8 @@ struct inode* dir_get_inode(struct dir* dir) {
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   The caller must hold DIR's entry lock. */
 static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp) {
   struct dir_entry e;
   size_t ofs;
@@ -88,6 +313,35 @@ static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
+  if (inode_is_hashed(dir->inode)) {
+    /* Names are compared in place, in the cached buckets, from
+       NAME's bucket on for as long as the buckets are flagged as
+       overflowed. */
+    size_t bucket_cnt = dir_bucket_cnt(dir);
+    size_t home = dir_bucket_of(name, bucket_cnt);
+    size_t idx = home;
+    bool found = false;
+    bool overflow;
+    do {
+      const struct dir_bucket* b = inode_get_block(dir->inode, idx * BLOCK_SECTOR_SIZE);
+      if (b == NULL)
+        return false;
+      for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++)
+        if (b->entries[i].in_use && !strcmp(name, b->entries[i].name)) {
+          if (ep != NULL)
+            *ep = b->entries[i];
+          if (ofsp != NULL)
+            *ofsp = idx * BLOCK_SECTOR_SIZE + i * sizeof(struct dir_entry);
+          found = true;
+          break;
+        }
+      overflow = b->overflow;
+      inode_put_block(b);
+      idx = dir_next_bucket(idx, bucket_cnt);
+    } while (!found && overflow && idx != home);
+    return found;
+  }
+
   for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
     if (e.in_use && !strcmp(name, e.name)) {
       if (ep != NULL)
@@ -101,79 +355,236 @@ static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep
 
 static int get_next_part(char part[NAME_MAX + 1], const char** srcp);
 
+/* Looks NAME up in the directory at sector PARENT, through the
+   directory entry cache.  On success, returns true and sets
+   *INODE_SECTOR to the sector of the named inode and *IS_DIR to
+   whether it is a directory. */
+static bool dir_lookup_part(block_sector_t parent, const char* name, block_sector_t* inode_sector, bool* is_dir) {
+  lock_acquire(&dir_cache_lock);
+  struct dir_cache_entry* ce = dir_cache_find(parent, name);
+  if (ce != NULL) {
+    list_remove(&ce->lru_elem);
+    list_push_back(&dir_cache_lru, &ce->lru_elem);
+    *inode_sector = ce->inode_sector;
+    *is_dir = ce->is_dir;
+    lock_release(&dir_cache_lock);
+    return *inode_sector != (block_sector_t)-1;
+  }
+  lock_release(&dir_cache_lock);
+
+  struct dir dir = {inode_open(parent), 0};
+  if (dir.inode == NULL)
+    return false;
+  if (!inode_is_dir(dir.inode)) {
+    inode_close(dir.inode);
+    return false;
+  }
+  /* The entry is cached while the directory is locked, so that a
+     concurrent dir_add() or dir_remove() invalidates it after the
+     insertion, not before. */
+  struct dir_entry e;
+  bool found = false;
+  inode_dir_lock_acquire(dir.inode, false);
+  if (!lookup(&dir, name, &e, NULL)) {
+    dir_cache_insert(parent, name, -1, false);
+  } else {
+    struct inode* inode = inode_open(e.inode_sector);
+    if (inode != NULL) {
+      found = true;
+      *inode_sector = e.inode_sector;
+      *is_dir = inode_is_dir(inode);
+      dir_cache_insert(parent, name, *inode_sector, *is_dir);
+      inode_close(inode);
+    }
+  }
+  inode_dir_lock_release(dir.inode, false);
+  inode_close(dir.inode);
+  return found;
+}
+
 /* Searches DIR for a file or dir with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE.*/
+   a null pointer.  The caller must close *INODE.
+   Path components are resolved by sector number through the
+   directory entry cache; only the final inode is opened. */
 enum DIR_LOOKUP_RESULT dir_lookup(const struct dir* a_dir, const char* name_full, struct inode** inode) {
-  struct dir_entry e;
-  enum DIR_LOOKUP_RESULT ret;
-
   ASSERT(a_dir != NULL);
   ASSERT(name_full != NULL);
 
   *inode = NULL;
 
-  struct inode* next = NULL;
-  bool next_is_dir = false;
+  block_sector_t sector = inode_get_inumber(a_dir->inode);
+  bool is_dir = true;
+  bool found = false;
   char name_local[NAME_MAX + 1];
 
-  struct dir* dir = dir_reopen(a_dir);
-  if (dir == NULL) { ret = DIR_LOOKUP_NOT_FOUND; goto done; }
   while (1) {
     int res = get_next_part(name_local, &name_full);
     ASSERT(res != -1);
-    if (res == 0) { // at end of file path.
-      if (next) {
-        *inode = inode_reopen(next); // must make a copy of inode, since next will be closed at cleanup.
-        ret = next_is_dir ? DIR_LOOKUP_FOUND_DIR : DIR_LOOKUP_FOUND_FILE; goto done;
-      } else {
-        ret =  DIR_LOOKUP_NOT_FOUND; goto done;
-      }
-    } else { // name_local corresponds to a valid file
-      if (next != NULL) {
-        if (!next_is_dir) { // not at the end, but next is not a dir.
-          ret = DIR_LOOKUP_NOT_FOUND; goto done;
-        }
-      }
-    }
-    if (!lookup(dir, name_local, &e, NULL)) { // entry not found
-      ret = DIR_LOOKUP_NOT_FOUND; goto done;
-    }
-    if (next != NULL) {
-      inode_close(next);// close previous inode
-    }
-    next = inode_open(e.inode_sector);
-    if (next == NULL) {
-      ret = DIR_LOOKUP_NOT_FOUND; goto done;
+    if (res == 0) // at end of file path.
+      break;
+    if (!is_dir) // not at the end, but the previous part is not a dir.
+      return DIR_LOOKUP_NOT_FOUND;
+    if (!dir_lookup_part(sector, name_local, &sector, &is_dir))
+      return DIR_LOOKUP_NOT_FOUND;
+    found = true;
+  }
+  if (!found)
+    return DIR_LOOKUP_NOT_FOUND;
+  *inode = inode_open(sector);
+  if (*inode == NULL)
+    return DIR_LOOKUP_NOT_FOUND;
+  return inode_is_dir(*inode) ? DIR_LOOKUP_FOUND_DIR : DIR_LOOKUP_FOUND_FILE;
+}
+
+/* Doubles the number of buckets of the hashed directory DIR,
+   moving every entry that dir_split_moves() from bucket I to
+   bucket I + the old number of buckets.  The new buckets are
+   built first, while the old ones still hold every entry, and
+   the new number of buckets is written along with bucket 0, so
+   that the directory keeps its old layout if that fails.
+   Returns false if DIR is at its maximum size or a disk or
+   memory error occurs. */
+static bool dir_split(struct dir* dir) {
+  size_t bucket_cnt = dir_bucket_cnt(dir);
+  bool success = false;
+
+  if (bucket_cnt == 0 || bucket_cnt >= DIR_MAX_BUCKETS)
+    return false;
+
+  struct dir_bucket* old_bucket = malloc(sizeof *old_bucket);
+  struct dir_bucket* new_bucket = malloc(sizeof *new_bucket);
+  if (old_bucket == NULL || new_bucket == NULL)
+    goto done;
+  /* A split that failed may have grown DIR already. */
+  if (inode_length(dir->inode) < (off_t)(2 * bucket_cnt * BLOCK_SECTOR_SIZE) &&
+      !inode_resize(dir->inode, 2 * bucket_cnt * BLOCK_SECTOR_SIZE))
+    goto done;
+
+  /* Build the new buckets.  A new bucket inherits the overflow
+     flag of its twin, since the entries that passed the twin now
+     pass it. */
+  for (size_t idx = 0; idx < bucket_cnt; idx++) {
+    size_t moved = 0;
+    if (!dir_read_bucket(dir, idx, old_bucket))
+      goto done;
+    memset(new_bucket, 0, sizeof *new_bucket);
+    new_bucket->overflow = old_bucket->overflow;
+    for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++) {
+      struct dir_entry* e = &old_bucket->entries[i];
+      if (e->in_use && dir_split_moves(e->name, idx, bucket_cnt))
+        new_bucket->entries[moved++] = *e;
     }
-    if (inode_is_dir(next)) { // directory
-      next_is_dir = true;
-      /* inode_reopen is called here because DIR will be closed by the end of call, 
-        whereas NEXT might be the return value. */
-      struct inode* next_dir_inode = inode_reopen(next);
-      dir_close(dir);
-      dir = dir_open(next_dir_inode); // open directory and keeps traversal
-      ASSERT(dir != NULL);
+    if (!dir_write_bucket(dir, idx + bucket_cnt, new_bucket))
+      goto done;
+  }
+
+  /* Drop the moved entries from the old buckets.  The split takes
+     effect when bucket 0 is written; an old bucket that fails to
+     be rewritten after that keeps copies that lookups never reach. */
+  for (size_t idx = 0; idx < bucket_cnt; idx++) {
+    if (!dir_read_bucket(dir, idx, old_bucket))
+      goto done;
+    for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++) {
+      struct dir_entry* e = &old_bucket->entries[i];
+      if (e->in_use && dir_split_moves(e->name, idx, bucket_cnt))
+        e->in_use = false;
     }
+    if (idx == 0)
+      old_bucket->bucket_cnt = 2 * bucket_cnt;
+    if (!dir_write_bucket(dir, idx, old_bucket))
+      goto done;
   }
-  
+  success = true;
+
 done:
-  if (next != NULL) {
-    inode_close(next);
-  }
-  if (dir != NULL) {
-    dir_close(dir);
-  }
-  switch (ret) {
-    case DIR_LOOKUP_FOUND_FILE:
-      break;
-    case DIR_LOOKUP_FOUND_DIR:
-      break;
-    case DIR_LOOKUP_NOT_FOUND:
-      break;
+  free(old_bucket);
+  free(new_bucket);
+  return success;
+}
+
+/* Returns true if splitting the hashed directory DIR, which has
+   BUCKET_CNT buckets, would leave room for NAME in its bucket,
+   i.e. if the entries kept in NAME's bucket HOME do not all land
+   on NAME's side of the split. */
+static bool dir_split_helps(struct dir* dir, const char* name, size_t home, size_t bucket_cnt) {
+  struct dir_bucket b;
+  bool name_moves = dir_split_moves(name, home, bucket_cnt);
+  size_t cnt = 0;
+
+  if (!dir_read_bucket(dir, home, &b))
+    return false;
+  for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++)
+    if (b.entries[i].in_use && dir_split_moves(b.entries[i].name, home, bucket_cnt) == name_moves)
+      cnt++;
+  return cnt < DIR_BUCKET_ENTRIES;
+}
+
+/* dir_add() for hashed directories: walks NAME's chain of
+   buckets, checking that NAME is not in use while looking for a
+   free slot.  If the chain is full, splits the directory when
+   that makes room in NAME's bucket, and otherwise overflows into
+   the first bucket past the chain with room, splitting only when
+   there is none.
+   The caller must hold DIR's entry lock exclusively. */
+static bool dir_add_hashed(struct dir* dir, const char* name, block_sector_t inode_sector) {
+  struct dir_bucket b;
+
+  for (;;) {
+    size_t bucket_cnt = dir_bucket_cnt(dir);
+    size_t home = dir_bucket_of(name, bucket_cnt);
+    size_t idx = home;
+    size_t last;
+    size_t free_idx = 0;
+    int free_slot = -1;
+
+    if (bucket_cnt == 0)
+      return false;
+    do {
+      if (!dir_read_bucket(dir, idx, &b))
+        return false;
+      for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++) {
+        if (!b.entries[i].in_use) {
+          if (free_slot < 0) {
+            free_slot = i;
+            free_idx = idx;
+          }
+        } else if (!strcmp(name, b.entries[i].name))
+          return false;
+      }
+      last = idx;
+      idx = dir_next_bucket(idx, bucket_cnt);
+    } while (b.overflow && idx != home);
+
+    if (free_slot < 0 && !(bucket_cnt < DIR_MAX_BUCKETS && dir_split_helps(dir, name, home, bucket_cnt))) {
+      for (; free_slot < 0 && idx != home; idx = dir_next_bucket(idx, bucket_cnt)) {
+        if (!dir_read_bucket(dir, idx, &b))
+          return false;
+        for (size_t i = 0; i < DIR_BUCKET_ENTRIES; i++)
+          if (!b.entries[i].in_use) {
+            free_slot = i;
+            free_idx = idx;
+            break;
+          }
+      }
+      /* Flag the chain's last bucket and the ones skipped after it. */
+      if (free_slot >= 0)
+        for (idx = last; idx != free_idx; idx = dir_next_bucket(idx, bucket_cnt))
+          if (!dir_set_overflow(dir, idx))
+            return false;
+    }
+
+    if (free_slot >= 0) {
+      struct dir_entry e;
+      e.in_use = true;
+      strlcpy(e.name, name, sizeof e.name);
+      e.inode_sector = inode_sector;
+      return inode_write_at(dir->inode, &e, sizeof e, free_idx * BLOCK_SECTOR_SIZE + free_slot * sizeof e) == sizeof e;
+    }
+    if (!dir_split(dir))
+      return false;
   }
-  return ret;
 }
 
 /* Adds a file/directory named NAME to DIR, which must not already contain a
@@ -194,6 +605,12 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
   if (*name == '\0' || strlen(name) > NAME_MAX)
     return false;
 
+  inode_dir_lock_acquire(dir->inode, true);
+  if (inode_is_hashed(dir->inode)) {
+    success = dir_add_hashed(dir, name, inode_sector);
+    goto done;
+  }
+
   /* Check that NAME is not in use. */
   if (lookup(dir, name, NULL, NULL))
     goto done;
@@ -224,6 +641,9 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
   success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
 
 done:
+  if (success)
+    dir_cache_invalidate(inode_get_inumber(dir->inode), name);
+  inode_dir_lock_release(dir->inode, true);
   return success;
 }
 
@@ -239,6 +659,14 @@ bool dir_remove(struct dir* dir, const char* name) {
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
+  /* "." and ".." never name an empty directory that nobody else
+     has open, so they can't be removed. Refusing them here also
+     keeps a directory from locking itself or its parent below. */
+  if (strcmp(name, name_cwd) == 0 || strcmp(name, name_prd) == 0)
+    return false;
+
+  inode_dir_lock_acquire(dir->inode, true);
+
   /* Find directory entry. */
   if (!lookup(dir, name, &e, &ofs))
     goto done;
@@ -265,9 +693,13 @@ bool dir_remove(struct dir* dir, const char* name) {
 
   /* Remove inode. */
   inode_remove(inode);
+  dir_cache_invalidate(inode_get_inumber(dir->inode), name);
+  if (inode_is_dir(inode))
+    dir_cache_invalidate_dir(e.inode_sector);
   success = true;
 
 done:
+  inode_dir_lock_release(dir->inode, true);
   if (inode != NULL) { inode_close(inode);}
   return success;
 }
@@ -277,18 +709,42 @@ done:
    contains no more entries. */
 bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1]) {
   struct dir_entry e;
+  bool success = false;
 
+  inode_dir_lock_acquire(dir->inode, false);
+  if (inode_is_hashed(dir->inode)) {
+    /* Scan the cached buckets in place, one pinned bucket at a
+       time.  The number of buckets is read up front, since a
+       thread holding a pin must not pin bucket 0 as well. */
+    off_t end = dir_bucket_cnt(dir) * BLOCK_SECTOR_SIZE;
+    const struct dir_bucket* b;
+    while (!success && dir->pos < end && (b = inode_get_block(dir->inode, dir->pos)) != NULL) {
+      do {
+        const struct dir_entry* ep = &b->entries[dir->pos % BLOCK_SECTOR_SIZE / sizeof *ep];
+        dir->pos = dir_bucket_next_ofs(dir->pos);
+        if (ep->in_use && strcmp(ep->name, name_cwd) != 0 && strcmp(ep->name, name_prd) != 0) { // ignore . and ..
+          strlcpy(name, ep->name, NAME_MAX + 1);
+          success = true;
+        }
+      } while (!success && dir->pos % BLOCK_SECTOR_SIZE != 0);
+      inode_put_block(b);
+    }
+    inode_dir_lock_release(dir->inode, false);
+    return success;
+  }
   while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
-    dir->pos += sizeof e;
+    dir->pos = dir_next_ofs(dir, dir->pos);
     if (e.in_use) {
       if (strcmp(e.name, name_cwd) == 0 || strcmp(e.name, name_prd) == 0) { // ignore . and ..
         continue;
       }
       strlcpy(name, e.name, NAME_MAX + 1);
-      return true;
+      success = true;
+      break;
     }
   }
-  return false;
+  inode_dir_lock_release(dir->inode, false);
+  return success;
 }
 
 /*Find the entry of A_INODE stored in A_DIR. Return NULL if A_DIR doesn't store A_INODE.*/
@@ -298,7 +754,7 @@ static struct dir_entry* dir_find_entry(struct dir* a_dir, struct inode* a_inode
   block_sector_t inode_number = inode_get_inumber(a_inode);
   ASSERT(a_dir != NULL);
   ASSERT(a_inode != NULL);
-  for (ofs = 0; inode_read_at(a_dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e) {
+  for (ofs = 0; inode_read_at(a_dir->inode, &e, sizeof e, ofs) == sizeof e; ofs = dir_next_ofs(a_dir, ofs)) {
     if (e.in_use && e.inode_sector == inode_number) {
       return &e;
     }
@@ -438,6 +894,9 @@ cleanup:
 size_t dir_get_size(struct dir* a_dir) {
   ASSERT(a_dir != NULL);
   ASSERT(a_dir->inode != NULL);
+  if (inode_is_hashed(a_dir->inode)) {
+    return dir_bucket_cnt(a_dir) * DIR_BUCKET_ENTRIES;
+  }
   return inode_length(a_dir->inode) / sizeof(struct dir_entry); // inode length is always multiple of sizeof(struct dir_entry)
 }
 
@@ -448,16 +907,20 @@ size_t dir_get_active_entries(struct dir* a_dir) {
   struct dir_entry e;
   size_t ofs;
   size_t count = 0;
-  for (ofs = 0; inode_read_at(a_dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e) {
+  inode_dir_lock_acquire(a_dir->inode, false);
+  for (ofs = 0; inode_read_at(a_dir->inode, &e, sizeof e, ofs) == sizeof e; ofs = dir_next_ofs(a_dir, ofs)) {
     if (e.in_use && strcmp(e.name, ".") != 0 && strcmp(e.name, "..") != 0) {
       count++;
     }
   }
+  inode_dir_lock_release(a_dir->inode, false);
   return count;
 }
 
+/* Grow the linear directory A_DIR to hold ENTRY_CNT entries. Hashed directories grow by splitting instead.*/
 bool dir_resize(struct dir* a_dir, size_t entry_cnt) {
   ASSERT(a_dir != NULL);
+  ASSERT(!inode_is_hashed(a_dir->inode));
   ASSERT(dir_get_size(a_dir) <= entry_cnt);
   return inode_resize(a_dir->inode, entry_cnt * sizeof(struct dir_entry));
 }
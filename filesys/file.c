@@ -8,8 +8,12 @@ struct file {
   struct inode* inode; /* File's inode. */
   off_t pos;           /* Current position. */
   bool deny_write;     /* Has file_deny_write() been called? */
+  off_t seq_pos;       /* Position right after the last file_read(), -1 before the first one. */
 };
 
+/* Number of sectors prefetched past the end of a sequential read. */
+#define FILE_READ_AHEAD_SECTORS 8
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -19,6 +23,7 @@ struct file* file_open(struct inode* inode) {
     file->inode = inode;
     file->pos = 0;
     file->deny_write = false;
+    file->seq_pos = -1;
     return file;
   } else {
     inode_close(inode);
@@ -51,10 +56,18 @@ struct inode* file_get_inode(struct file* file) {
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   If the read continues where the previous one stopped, the
+   sectors following the ones it touches are prefetched while it
+   runs, ready for the next read. */
 off_t file_read(struct file* file, void* buffer, off_t size) {
+  if (size > 0 && file->pos == file->seq_pos) {
+    off_t next = DIV_ROUND_UP(file->pos + size, BLOCK_SECTOR_SIZE) * BLOCK_SECTOR_SIZE;
+    inode_read_ahead(file->inode, next, FILE_READ_AHEAD_SECTORS);
+  }
   off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file->seq_pos = file->pos;
   return bytes_read;
 }
 
@@ -21,12 +21,19 @@ void filesys_init(bool format) {
     PANIC("No file system device found, can't initialize file system.");
 
   inode_init();
+  dir_init();
   free_map_init();
 
   if (format)
     do_format();
 
   free_map_open();
+#if ENABLE_BUFFER_CACHE
+  /* The flusher syncs the free map on every pass, so it starts once the free map is open. */
+  if (!buffer_cache_start_flusher(fs_buffer_cache)) {
+    PANIC("Failed to start buffer cache flusher");
+  }
+#endif
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -34,7 +41,7 @@ void filesys_init(bool format) {
 void filesys_done(void) { 
   free_map_close();
 #if ENABLE_BUFFER_CACHE
-    buffer_cache_flush(fs_buffer_cache);
+  buffer_cache_flush(fs_buffer_cache);
 #endif
 
 }
@@ -53,7 +60,7 @@ bool filesys_create(const char* a_full_name, off_t initial_size) {
     success = free_map_allocate(1, &inode_sector);
   }
   if (success) {
-    success = inode_create(inode_sector, initial_size, false);
+    success = inode_create(inode_sector, initial_size, false, false);
   }
   if (success) {
     success = dir_add(dir, file_name, inode_sector);
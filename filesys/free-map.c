@@ -5,11 +5,27 @@
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/synch.h"
+#include "lib/utils.h"
 
 static struct file* free_map_file; /* Free map file. */
 static struct bitmap* free_map;    /* Free map, one bit per sector. */
 
 static struct lock free_map_lock; /* Lock for free map. */
+static size_t free_map_hint;      /* Next-fit hint: where the last allocation ended. */
+
+/* Sectors of the free map file that are out of date, one bit per
+   sector.  They are written back by free_map_sync(). */
+static struct bitmap* free_map_dirty;
+static unsigned long long free_map_write_cnt; /* Free map file sectors written. */
+
+/* Serializes free_map_sync() and free_map_close(), and guards
+   free_map_file and free_map_sync_buffer.  Acquired before
+   free_map_lock, never while holding it. */
+static struct lock free_map_sync_lock;
+static uint8_t free_map_sync_buffer[BLOCK_SECTOR_SIZE]; /* Snapshot of the sector being written back. */
+
+/* Number of free map bits stored in one sector of its file. */
+#define FREE_MAP_BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
 
 /* Initializes the free map. */
 void free_map_init(void) {
@@ -18,62 +34,176 @@ void free_map_init(void) {
     PANIC("bitmap creation failed--file system device is too large");
   bitmap_mark(free_map, FREE_MAP_SECTOR);
   bitmap_mark(free_map, ROOT_DIR_SECTOR);
+  free_map_dirty = bitmap_create(DIV_ROUND_UP(bitmap_file_size(free_map), BLOCK_SECTOR_SIZE));
+  if (free_map_dirty == NULL)
+    PANIC("bitmap creation failed--file system device is too large");
   lock_init(&free_map_lock);
+  lock_init(&free_map_sync_lock);
+  free_map_hint = 0;
+  free_map_write_cnt = 0;
+}
+
+/* Marks the free map file sectors holding the bits of CNT
+   sectors starting at SECTOR as out of date.
+   Must be called with free_map_lock held. */
+static void free_map_mark_dirty(size_t sector, size_t cnt) {
+  size_t first = sector / FREE_MAP_BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / FREE_MAP_BITS_PER_SECTOR;
+  bitmap_set_multiple(free_map_dirty, first, last - first + 1, true);
+}
+
+/* Returns the first sector of a run of CNT free sectors, looking
+   from the next-fit hint to the end of the disk and then from
+   the start, or BITMAP_ERROR if there is no such run.
+   Must be called with free_map_lock held. */
+static size_t free_map_scan(size_t cnt) {
+  size_t sector = bitmap_scan(free_map, free_map_hint, cnt, false);
+  if (sector == BITMAP_ERROR && free_map_hint != 0)
+    sector = bitmap_scan(free_map, 0, cnt, false);
+  return sector;
+}
+
+/* Marks CNT sectors starting at SECTOR as used and moves the
+   next-fit hint past them.  The free map file is updated by the
+   next free_map_sync().
+   Must be called with free_map_lock held. */
+static void free_map_take(size_t sector, size_t cnt) {
+  bitmap_set_multiple(free_map, sector, cnt, true);
+  free_map_mark_dirty(sector, cnt);
+  free_map_hint = sector + cnt < bitmap_size(free_map) ? sector + cnt : 0;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool free_map_allocate(size_t cnt, block_sector_t* sectorp) {
   lock_acquire(&free_map_lock);
-  block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file)) {
-    bitmap_set_multiple(free_map, sector, cnt, false);
-    sector = BITMAP_ERROR;
-  }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+  size_t sector = free_map_scan(cnt);
   bool ret = sector != BITMAP_ERROR;
+  if (ret) {
+    free_map_take(sector, cnt);
+    *sectorp = sector;
+  }
   lock_release(&free_map_lock);
   return ret;
 }
 
+/* Allocates between 1 and CNT consecutive sectors from the free
+   map, stores the first into *SECTORP and returns how many were
+   allocated, or 0 if the disk is full.
+   The run starts at GOAL if that sector is free, so that a file
+   grows contiguously after its last block; otherwise a run of CNT
+   sectors is looked for from the next-fit hint, and failing that
+   the first free run is taken whatever its length. */
+size_t free_map_allocate_extent(size_t cnt, block_sector_t goal, block_sector_t* sectorp) {
+  ASSERT(cnt > 0);
+  lock_acquire(&free_map_lock);
+  size_t size = bitmap_size(free_map);
+  size_t sector = goal;
+  if (goal >= size || bitmap_test(free_map, goal)) {
+    sector = free_map_scan(cnt);
+    if (sector == BITMAP_ERROR)
+      sector = free_map_scan(1);
+  }
+  size_t got = 0;
+  if (sector != BITMAP_ERROR) {
+    for (got = 1; got < cnt && sector + got < size && !bitmap_test(free_map, sector + got); got++)
+      continue;
+    free_map_take(sector, got);
+    *sectorp = sector;
+  }
+  lock_release(&free_map_lock);
+  return got;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void free_map_release(block_sector_t sector, size_t cnt) {
   ASSERT(bitmap_all(free_map, sector, cnt));
   lock_acquire(&free_map_lock);
   bitmap_set_multiple(free_map, sector, cnt, false);
-  bitmap_write(free_map, free_map_file);
+  free_map_mark_dirty(sector, cnt);
   lock_release(&free_map_lock);
 }
 
+/* Writes the out-of-date sectors of the free map file back from
+   the in-memory free map.  Does nothing while the free map file
+   is not open.  Each sector is snapshotted under free_map_lock
+   and written after releasing it, so allocations don't wait for
+   the disk and the lock is never held inside the buffer cache. */
+void free_map_sync(void) {
+  lock_acquire(&free_map_sync_lock);
+  if (free_map_file != NULL) {
+    size_t i;
+    for (i = 0; i < bitmap_size(free_map_dirty); i++) {
+      size_t size = 0;
+      lock_acquire(&free_map_lock);
+      bool dirty = bitmap_test(free_map_dirty, i);
+      if (dirty) {
+        bitmap_reset(free_map_dirty, i);
+        size = bitmap_copy_file_image(free_map, i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE, free_map_sync_buffer);
+      }
+      lock_release(&free_map_lock);
+      if (!dirty)
+        continue;
+
+      bool written = file_write_at(free_map_file, free_map_sync_buffer, size, i * BLOCK_SECTOR_SIZE) == (off_t)size;
+      lock_acquire(&free_map_lock);
+      if (written)
+        free_map_write_cnt++;
+      else
+        bitmap_mark(free_map_dirty, i);
+      lock_release(&free_map_lock);
+    }
+  }
+  lock_release(&free_map_sync_lock);
+}
+
+/* Returns the number of free map file sectors written so far. */
+unsigned long long free_map_get_write_cnt(void) {
+  lock_acquire(&free_map_lock);
+  unsigned long long ret = free_map_write_cnt;
+  lock_release(&free_map_lock);
+  return ret;
+}
+
 /* Opens the free map file and reads it from disk. */
 void free_map_open(void) {
-  free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  struct file* file = file_open(inode_open(FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC("can't open free map");
-  if (!bitmap_read(free_map, free_map_file))
+  if (!bitmap_read(free_map, file))
     PANIC("can't read free map");
+  bitmap_set_all(free_map_dirty, false);
+  lock_acquire(&free_map_sync_lock);
+  free_map_file = file;
+  lock_release(&free_map_sync_lock);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void free_map_close(void) { 
+  free_map_sync();
+  lock_acquire(&free_map_sync_lock);
   file_close(free_map_file);
+  free_map_file = NULL;
+  lock_release(&free_map_sync_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
    it. */
 void free_map_create(void) {
   /* Create inode. */
-  if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map), false))
+  if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map), false, false))
     PANIC("free map creation failed");
 
   /* Write bitmap to file. */
-  free_map_file = file_open(inode_open(FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  struct file* file = file_open(inode_open(FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC("can't open free map");
+  lock_acquire(&free_map_sync_lock);
+  free_map_file = file;
+  lock_release(&free_map_sync_lock);
   if (!bitmap_write(free_map, free_map_file))
     PANIC("can't write free map");
+  bitmap_set_all(free_map_dirty, false);
 }
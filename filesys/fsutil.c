@@ -10,6 +10,7 @@
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
+#include "lib/utils.h"
 
 /* List files in the root directory. */
 void fsutil_ls(char** argv UNUSED) {
@@ -70,7 +71,7 @@ void fsutil_extract(char** argv UNUSED) {
 
   /* Allocate buffers. */
   header = malloc(BLOCK_SECTOR_SIZE);
-  data = malloc(BLOCK_SECTOR_SIZE);
+  data = palloc_get_page(0);
   if (header == NULL || data == NULL)
     PANIC("couldn't allocate buffers");
 
@@ -111,10 +112,12 @@ void fsutil_extract(char** argv UNUSED) {
       if (dst == NULL)
         PANIC("%s: open failed", file_name);
 
-      /* Do copy. */
+      /* Do copy, a page at a time. */
       while (size > 0) {
-        int chunk_size = (size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size);
-        block_read(src, sector++, data);
+        int chunk_size = (size > PGSIZE ? PGSIZE : size);
+        block_sector_t chunk_sectors = DIV_ROUND_UP(chunk_size, BLOCK_SECTOR_SIZE);
+        block_read_multiple(src, sector, chunk_sectors, data);
+        sector += chunk_sectors;
         if (file_write(dst, data, chunk_size) != chunk_size)
           PANIC("%s: write failed with %d bytes unwritten", file_name, size);
         size -= chunk_size;
@@ -134,7 +137,7 @@ void fsutil_extract(char** argv UNUSED) {
   block_write(src, 0, header);
   block_write(src, 1, header);
 
-  free(data);
+  palloc_free_page(data);
   free(header);
 }
 
@@ -158,7 +161,7 @@ void fsutil_append(char** argv) {
   printf("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc(BLOCK_SECTOR_SIZE);
+  buffer = palloc_get_page(0);
   if (buffer == NULL)
     PANIC("couldn't allocate buffer");
 
@@ -178,15 +181,17 @@ void fsutil_append(char** argv) {
     PANIC("%s: name too long for ustar format", file_name);
   block_write(dst, sector++, buffer);
 
-  /* Do copy. */
+  /* Do copy, a page at a time. */
   while (size > 0) {
-    int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-    if (sector >= block_size(dst))
+    int chunk_size = size > PGSIZE ? PGSIZE : size;
+    block_sector_t chunk_sectors = DIV_ROUND_UP(chunk_size, BLOCK_SECTOR_SIZE);
+    if (sector + chunk_sectors > block_size(dst))
       PANIC("%s: out of space on scratch device", file_name);
     if (file_read(src, buffer, chunk_size) != chunk_size)
       PANIC("%s: read failed with %" PROTd " bytes unread", file_name, size);
-    memset(buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-    block_write(dst, sector++, buffer);
+    memset(buffer + chunk_size, 0, chunk_sectors * BLOCK_SECTOR_SIZE - chunk_size);
+    block_write_multiple(dst, sector, chunk_sectors, buffer);
+    sector += chunk_sectors;
     size -= chunk_size;
   }
 
@@ -199,5 +204,5 @@ void fsutil_append(char** argv) {
 
   /* Finish up. */
   file_close(src);
-  free(buffer);
+  palloc_free_page(buffer);
 }
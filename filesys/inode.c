@@ -1,5 +1,6 @@
 #include "filesys/inode.h"
 #include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
@@ -10,17 +11,23 @@
 #include "lib/utils.h"
 #include "buffer_cache.h"
 
-/*Read a whole block of data using either buffer cache or direcly from block, depending on whether buffer cache is active.*/
+/*Read a whole block of metadata (an inode or an indirect block) using either buffer cache or direcly from block, depending on whether buffer cache is active.*/
 #define FS_READ_BLOCK(src, dst) \
-   if(ENABLE_BUFFER_CACHE) {buffer_cache_read(fs_buffer_cache, src, dst, 0, BLOCK_SECTOR_SIZE);} \
+   if(ENABLE_BUFFER_CACHE) {buffer_cache_read(fs_buffer_cache, src, dst, 0, BLOCK_SECTOR_SIZE, BUFFER_CACHE_META);} \
    else {block_read(fs_device, src, dst);}
 
 #define FS_WRITE_BLOCK(src, dst) \
-    if(ENABLE_BUFFER_CACHE) {buffer_cache_write(fs_buffer_cache, dst, src, 0, BLOCK_SECTOR_SIZE);} \
+    if(ENABLE_BUFFER_CACHE) {buffer_cache_write(fs_buffer_cache, dst, src, 0, BLOCK_SECTOR_SIZE, BUFFER_CACHE_META);} \
     else {block_write(fs_device, dst, src);}
     
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
+/* Identifies the inode of a hashed directory, see inode_is_hashed(). Disks written before that format existed only
+  carry INODE_MAGIC, so this magic, not the is_hashed byte, is what tells the formats apart on disk.*/
+#define INODE_MAGIC_HASHED_DIR 0x494e4f48
+
+/* Magic number to store for the inode whose data is A_DATA. */
+#define INODE_DATA_MAGIC(a_data) ((a_data)->is_hashed ? INODE_MAGIC_HASHED_DIR : INODE_MAGIC)
 
 /*A direct inode data block, storing BLOCK_SECTOR_SIZE(512) bytes*/
 typedef struct {
@@ -45,12 +52,14 @@ typedef struct {
 
 #define INODE_DISK_NUM_DIRECT_BLOCKS (BLOCK_SECTOR_SIZE \
   - INODE_DISK_NUM_IDIRECT_BLOCKS_2 * sizeof(block_sector_t) \
-  - sizeof(bool) - sizeof(off_t) - sizeof(unsigned)) / sizeof(block_sector_t)
+  - 2 * sizeof(bool) - sizeof(off_t) - sizeof(unsigned)) / sizeof(block_sector_t)
 
 #define INODE_DISK_NUM_DIRECT_BLOCKS_CAPACITY_BYTE (INODE_DISK_NUM_DIRECT_BLOCKS * BLOCK_SECTOR_SIZE)
 
 struct inode_data {
   bool is_dir;         /* true if this inode corresponds a directory*/
+  bool is_hashed;      /* true if this directory hashes its entries into sector-sized buckets. Only trusted in memory:
+                          old disks hold garbage here, the magic number is authoritative.*/
   off_t size;         /* File size in bytes. */
   block_sector_t l2_blocks[INODE_DISK_NUM_IDIRECT_BLOCKS_2]; /* 2nd level indirect sector*/
   block_sector_t l0_blocks[INODE_DISK_NUM_DIRECT_BLOCKS]; /* directy sectors*/
@@ -71,9 +80,18 @@ struct inode_disk {
    bytes long. */
 static inline size_t bytes_to_sectors(off_t size) { return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE); }
 
+/* Translation cache of an in-memory inode: the entries of the
+   1st-level indirect block used last, so that consecutive sectors
+   past the direct region don't go through the indirect blocks each. */
+struct inode_map {
+  int l1_idx; /* Index of the cached 1st-level block within the indirect region, -1 if none. */
+  block_sector_t data_blocks[INDIRECT_BLOCK_NUM_ENTRIES]; /* Its entries. */
+};
+
 /* In-memory inode. */
 struct inode {
-  struct list_elem elem;  /* Element in inode list. */
+  struct list_elem elem;  /* Element in the open inode bucket of SECTOR. */
+  struct list_elem idle_elem; /* Element in idle_inodes while OPEN_CNT is 0. */
   block_sector_t sector;  /* Sector number of disk location. */
   int open_cnt;           /* Number of openers. */
   bool removed;           /* True if deleted, false otherwise. */
@@ -81,6 +99,9 @@ struct inode {
   struct lock mtx_0;        /* Lock for metadatas.*/
   rwLock deny_write_cnt_lock; /* Lock for deny_write_cnt */
   rwLock size_lock; /* Lock for size, used when resizing during read()*/
+  struct rw_lock dir_lock; /* Lock for the entries of a directory, see inode_dir_lock_acquire().*/
+  struct lock map_lock; /* Lock for map. */
+  struct inode_map* map; /* Translation cache, allocated on first use. */
   /* Data fetched from inode_disk*/
   struct inode_data block_data;
 };
@@ -88,24 +109,24 @@ struct inode {
 static void inode_writeback(struct inode *inode) {
   struct inode_disk disk_inode;
   disk_inode.block_data = inode->block_data;
-  disk_inode.magic = INODE_MAGIC;
+  disk_inode.magic = INODE_DATA_MAGIC(&inode->block_data);
   memset(disk_inode.padding, 0, INODE_DISK_PADDING);
   FS_WRITE_BLOCK(&disk_inode, inode->sector);
 }
 
 
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
-static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
-  ASSERT(inode != NULL);
-  if (pos > inode->block_data.size) {
+   within the inode data BLOCK_DATA.
+   Returns -1 if BLOCK_DATA does not contain data for a byte at
+   offset POS. */
+static block_sector_t inode_data_to_sector(const struct inode_data* block_data, off_t pos) {
+  ASSERT(block_data != NULL);
+  if (pos > block_data->size) {
     return -1;
   }
 
   if (pos < INODE_DISK_NUM_DIRECT_BLOCKS_CAPACITY_BYTE) {
-    return inode->block_data.l0_blocks[pos / BLOCK_SECTOR_SIZE];
+    return block_data->l0_blocks[pos / BLOCK_SECTOR_SIZE];
   }
 
   pos -= INODE_DISK_NUM_DIRECT_BLOCKS_CAPACITY_BYTE;
@@ -115,30 +136,143 @@ static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
   int l1_block_idx = (pos % INDIRECT_BLOCK_2_CAPACITY_BYTE) / INDIRECT_BLOCK_1_CAPACITY_BYTE;
   // which data block?
   int l0_block_idx = (pos % INDIRECT_BLOCK_1_CAPACITY_BYTE) / BLOCK_SECTOR_SIZE;
-  // read the level 2 block
-  block_sector_t indirect_block_2_sector = inode->block_data.l2_blocks[l2_block_idx];
-  block_sector_t indirect_block_1_sector;
-  buffer_cache_read(fs_buffer_cache, indirect_block_2_sector, &indirect_block_1_sector, l1_block_idx * sizeof(block_sector_t), sizeof(block_sector_t));
-  block_sector_t data_block_sector;
-  buffer_cache_read(fs_buffer_cache, indirect_block_1_sector, &data_block_sector, l0_block_idx * sizeof(block_sector_t), sizeof(block_sector_t));
+  // read the level 2 block, then the level 1 block, in place
+  const block_sector_t* indirect_block_2 = buffer_cache_get(fs_buffer_cache, block_data->l2_blocks[l2_block_idx], false, BUFFER_CACHE_META);
+  block_sector_t indirect_block_1_sector = indirect_block_2[l1_block_idx];
+  buffer_cache_put(fs_buffer_cache, indirect_block_2, false);
+  const block_sector_t* indirect_block_1 = buffer_cache_get(fs_buffer_cache, indirect_block_1_sector, false, BUFFER_CACHE_META);
+  block_sector_t data_block_sector = indirect_block_1[l0_block_idx];
+  buffer_cache_put(fs_buffer_cache, indirect_block_1, false);
   return data_block_sector;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
-static struct lock open_inodes_mtx;
+/* Returns the block device sector that contains byte offset POS
+   within INODE.
+   Returns -1 if INODE does not contain data for a byte at offset
+   POS.
+   Sectors past the direct region are looked up in INODE's
+   translation cache, which is refilled from the indirect blocks
+   only when POS moves to another 1st-level block. */
+static block_sector_t byte_to_sector(struct inode* inode, off_t pos) {
+  ASSERT(inode != NULL);
+  if (pos > inode->block_data.size || pos < INODE_DISK_NUM_DIRECT_BLOCKS_CAPACITY_BYTE) {
+    return inode_data_to_sector(&inode->block_data, pos);
+  }
+
+  off_t indirect_pos = pos - INODE_DISK_NUM_DIRECT_BLOCKS_CAPACITY_BYTE;
+  int l1_idx = indirect_pos / INDIRECT_BLOCK_1_CAPACITY_BYTE; // which 1st-level block of the whole indirect region
+  int l0_block_idx = (indirect_pos % INDIRECT_BLOCK_1_CAPACITY_BYTE) / BLOCK_SECTOR_SIZE;
+
+  lock_acquire(&inode->map_lock);
+  if (inode->map == NULL) {
+    inode->map = malloc(sizeof(struct inode_map));
+    if (inode->map == NULL) { // memory shortage, go through the indirect blocks
+      lock_release(&inode->map_lock);
+      return inode_data_to_sector(&inode->block_data, pos);
+    }
+    inode->map->l1_idx = -1;
+  }
+  if (inode->map->l1_idx != l1_idx) {
+    const block_sector_t* indirect_block_2 = buffer_cache_get(fs_buffer_cache, inode->block_data.l2_blocks[l1_idx / INDIRECT_BLOCK_NUM_ENTRIES], false, BUFFER_CACHE_META);
+    block_sector_t indirect_block_1_sector = indirect_block_2[l1_idx % INDIRECT_BLOCK_NUM_ENTRIES];
+    buffer_cache_put(fs_buffer_cache, indirect_block_2, false);
+    FS_READ_BLOCK(indirect_block_1_sector, inode->map->data_blocks);
+    inode->map->l1_idx = l1_idx;
+  }
+  block_sector_t ret = inode->map->data_blocks[l0_block_idx];
+  lock_release(&inode->map_lock);
+  return ret;
+}
+
+/* Returns the buffer cache class of the sectors of INODE: directories and the free map are metadata. */
+static enum buffer_cache_class inode_class(const struct inode* inode) {
+  return inode->block_data.is_dir || inode->sector == FREE_MAP_SECTOR ? BUFFER_CACHE_META : BUFFER_CACHE_DATA;
+}
+
+/* Drops INODE's translation cache. Must be called whenever INODE's indirect blocks change.*/
+static void inode_map_invalidate(struct inode* inode) {
+  lock_acquire(&inode->map_lock);
+  if (inode->map != NULL) {
+    inode->map->l1_idx = -1;
+  }
+  lock_release(&inode->map_lock);
+}
+
+/* Table of open inodes, so that opening a single inode twice
+   returns the same `struct inode'.  Inodes are spread over
+   buckets by sector number, each with its own lock, so that
+   opens and closes of different inodes rarely contend. */
+#define OPEN_INODE_BUCKETS 64
+
+struct open_inode_bucket {
+  struct lock lock;    /* Lock for INODES and for the open_cnt of each inode in it reaching 0. */
+  struct list inodes;  /* Open inodes whose sector maps to this bucket. */
+};
+
+static struct open_inode_bucket open_inodes[OPEN_INODE_BUCKETS];
+
+/* Inodes nobody has open that stay in the table, least recently
+   closed first, so that reopening them doesn't read the disk
+   inode again.  Only inodes that are not removed are kept; their
+   disk inode is always up to date, so they can be freed at any
+   time. */
+static struct list idle_inodes;
+static struct lock idle_inodes_lock;
+static size_t idle_inode_cnt;
+size_t inode_cache_size = INODE_CACHE_DEFAULT_SIZE;
+
+/* Returns the open inode bucket for SECTOR. */
+static struct open_inode_bucket* open_inode_bucket(block_sector_t sector) {
+  return &open_inodes[hash_int(sector) % OPEN_INODE_BUCKETS];
+}
+
+/* Frees the least recently closed idle inodes until at most
+   LIMIT are left.  Bucket locks are only tried, since the
+   caller may hold one and they are normally taken before
+   idle_inodes_lock; inodes whose bucket is busy are skipped. */
+static void inode_cache_trim(size_t limit) {
+  struct list doomed;
+  list_init(&doomed);
+  lock_acquire(&idle_inodes_lock);
+  struct list_elem* e = list_begin(&idle_inodes);
+  while (idle_inode_cnt > limit && e != list_end(&idle_inodes)) {
+    struct inode* inode = list_entry(e, struct inode, idle_elem);
+    struct open_inode_bucket* bucket = open_inode_bucket(inode->sector);
+    e = list_next(e);
+    if (!lock_held_by_current_thread(&bucket->lock) && lock_try_acquire(&bucket->lock)) {
+      list_remove(&inode->elem);
+      lock_release(&bucket->lock);
+      list_remove(&inode->idle_elem);
+      idle_inode_cnt--;
+      list_push_back(&doomed, &inode->idle_elem);
+    }
+  }
+  lock_release(&idle_inodes_lock);
+  while (!list_empty(&doomed)) {
+    struct inode* inode = list_entry(list_pop_front(&doomed), struct inode, idle_elem);
+    free(inode->map);
+    free(inode);
+  }
+}
 
 static bool inode_data_resize(struct inode_data* a_inode_data, size_t a_size);
 
 /* Initializes the inode module. */
 void inode_init(void) { 
-  list_init(&open_inodes); 
-  lock_init(&open_inodes_mtx);
+  for (int i = 0; i < OPEN_INODE_BUCKETS; i++) {
+    list_init(&open_inodes[i].inodes);
+    lock_init(&open_inodes[i].lock);
+  }
+  list_init(&idle_inodes);
+  lock_init(&idle_inodes_lock);
+  idle_inode_cnt = 0;
 #if ENABLE_BUFFER_CACHE
   fs_buffer_cache = buffer_cache_create(fs_device);
   if (fs_buffer_cache == NULL) {
-    PANIC("Failed to create inode buffer cache");
+    PANIC("Failed to create inode buffer cache of %zu sectors", buffer_cache_size);
+  }
+  if (!buffer_cache_start_read_ahead(fs_buffer_cache)) {
+    PANIC("Failed to start buffer cache read-ahead worker");
   }
 #endif
   INFO2("Dumping inode data");
@@ -155,19 +289,24 @@ void inode_init(void) {
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
    device.
+   IS_HASHED selects the hashed directory format, see
+   filesys/directory.c; it requires IS_DIRECTORY.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
-bool inode_create(block_sector_t sector, off_t length, bool is_directory) { //sector is allocated beforehand.
+bool inode_create(block_sector_t sector, off_t length, bool is_directory, bool is_hashed) { //sector is allocated beforehand.
   bool success = false;
 
   ASSERT(length >= 0);
+  ASSERT(is_directory || !is_hashed);
 
   ASSERT(sizeof (struct inode_disk) == BLOCK_SECTOR_SIZE);
 
   struct inode_disk disk_inode;
+  memset(&disk_inode, 0, sizeof disk_inode);
   disk_inode.block_data.size = 0;
   disk_inode.block_data.is_dir = is_directory;
-  disk_inode.magic = INODE_MAGIC;
+  disk_inode.block_data.is_hashed = is_hashed;
+  disk_inode.magic = INODE_DATA_MAGIC(&disk_inode.block_data);
   success = inode_data_resize(&disk_inode.block_data, length);// no lock is needed here since the inode is not yet in the inode list
   if (success) {
     FS_WRITE_BLOCK(&disk_inode, sector);
@@ -185,23 +324,36 @@ struct inode* inode_open(block_sector_t sector) {
   struct inode* inode;
 
   /* Check whether this inode is already open. */
-  lock_acquire(&open_inodes_mtx); // lock read&write to open_inodes_list.
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
+  struct open_inode_bucket* bucket = open_inode_bucket(sector);
+  lock_acquire(&bucket->lock);
+  for (e = list_begin(&bucket->inodes); e != list_end(&bucket->inodes); e = list_next(e)) {
     inode = list_entry(e, struct inode, elem);
     if (inode->sector == sector) {
+      if (inode->open_cnt == 0) { // revive an idle inode
+        lock_acquire(&idle_inodes_lock);
+        list_remove(&inode->idle_elem);
+        idle_inode_cnt--;
+        lock_release(&idle_inodes_lock);
+      }
       inode_reopen(inode);
-      lock_release(&open_inodes_mtx);
+      lock_release(&bucket->lock);
       return inode;
     }
   }
 
-  /* Allocate memory. */
+  /* Allocate memory, giving up the idle inodes if it is short. */
   inode = malloc(sizeof *inode);
-  if (inode == NULL)
+  if (inode == NULL) {
+    inode_cache_trim(0);
+    inode = malloc(sizeof *inode);
+  }
+  if (inode == NULL) {
+    lock_release(&bucket->lock);
     return NULL;
+  }
 
-  /* Initialize. */
-  list_push_front(&open_inodes, &inode->elem);
+  /* Initialize. The bucket stays locked until the inode is read, so that nobody sees it half-initialized. */
+  list_push_front(&bucket->inodes, &inode->elem);
   
   inode->sector = sector;
   inode->open_cnt = 1;
@@ -210,12 +362,16 @@ struct inode* inode_open(block_sector_t sector) {
   lock_init(&inode->mtx_0);
   rwLock_init(&inode->deny_write_cnt_lock);
   rwLock_init(&inode->size_lock);
+  rw_lock_init(&inode->dir_lock);
+  lock_init(&inode->map_lock);
+  inode->map = NULL;
 
   struct inode_disk buf;
   FS_READ_BLOCK(inode->sector, &buf);
   inode->block_data = buf.block_data;
+  inode->block_data.is_hashed = buf.magic == INODE_MAGIC_HASHED_DIR;
   
-  lock_release(&open_inodes_mtx);
+  lock_release(&bucket->lock);
   return inode;
 }
 
@@ -241,15 +397,32 @@ void inode_close(struct inode* inode) {
   if (inode == NULL)
     return;
   
+  /* The bucket lock keeps inode_open() from reviving INODE between the last close and its removal from the table. */
+  struct open_inode_bucket* bucket = open_inode_bucket(inode->sector);
+  lock_acquire(&bucket->lock);
   lock_acquire(&inode->mtx_0);
   --inode->open_cnt;
   int open_cnt = inode->open_cnt;
   lock_release(&inode->mtx_0);
+  bool idle = false;
+  if (open_cnt == 0) {
+    idle = !inode->removed && inode_cache_size > 0;
+    if (idle) { // keep it in the table for inode_open()
+      lock_acquire(&idle_inodes_lock);
+      list_push_back(&idle_inodes, &inode->idle_elem);
+      idle_inode_cnt++;
+      lock_release(&idle_inodes_lock);
+    } else {
+      list_remove(&inode->elem);
+    }
+  }
+  lock_release(&bucket->lock);
 
+  if (idle) {
+    inode_cache_trim(inode_cache_size);
+  }
   /* Release resources if this was the last opener. */
-  if (open_cnt == 0) {
-    /* Remove from inode list and release lock. */
-    list_remove(&inode->elem);
+  else if (open_cnt == 0) {
     /* Deallocate blocks if removed. */
     if (inode->removed) { 
       int num_l0 = bytes_to_sectors(inode->block_data.size);
@@ -288,6 +461,7 @@ void inode_close(struct inode* inode) {
       }
       free_map_release(inode->sector, 1); // release disk inode
     }
+    free(inode->map);
     free(inode);
   }
 }
@@ -334,7 +508,17 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
       break;
 
 #if ENABLE_BUFFER_CACHE
-    buffer_cache_read(fs_buffer_cache, sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+    if (chunk_size == BLOCK_SECTOR_SIZE && size >= 2 * BLOCK_SECTOR_SIZE) {
+      /* Read the run of whole sectors that are contiguous on disk
+         with one request, e.g. a page loaded by load_segment(). */
+      off_t run_max = (size < inode_left ? size : inode_left) / BLOCK_SECTOR_SIZE;
+      off_t run = 1;
+      while (run < run_max && byte_to_sector(inode, offset + run * BLOCK_SECTOR_SIZE) == sector_idx + run)
+        run++;
+      buffer_cache_read_multiple(fs_buffer_cache, sector_idx, run, buffer + bytes_read, inode_class(inode));
+      chunk_size = run * BLOCK_SECTOR_SIZE;
+    } else
+      buffer_cache_read(fs_buffer_cache, sector_idx, buffer + bytes_read, sector_ofs, chunk_size, inode_class(inode));
 #else
     if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
       /* Read full sector directly into caller's buffer. */
@@ -362,6 +546,42 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
   return bytes_read;
 }
 
+/* Pins the sector that holds byte OFFSET of INODE in the buffer
+   cache and returns its data, to be read in place.  Returns a
+   null pointer if OFFSET is past the end of INODE.  The sector
+   must be handed back with inode_put_block(). */
+const void* inode_get_block(struct inode* inode, off_t offset) {
+  if (offset >= inode_length(inode)) {
+    return NULL;
+  }
+  block_sector_t sector_idx = byte_to_sector(inode, offset);
+  if (sector_idx == (block_sector_t)-1) {
+    return NULL;
+  }
+  return buffer_cache_get(fs_buffer_cache, sector_idx, false, inode_class(inode));
+}
+
+/* Unpins BLOCK, returned by inode_get_block(). */
+void inode_put_block(const void* block) {
+  buffer_cache_put(fs_buffer_cache, block, false);
+}
+
+/* Asks the buffer cache to load, in the background, up to CNT
+   sectors of INODE starting with the one that contains byte
+   OFFSET.  Sectors past the end of INODE are ignored. */
+void inode_read_ahead(struct inode* inode, off_t offset, size_t cnt) {
+#if ENABLE_BUFFER_CACHE
+  off_t inode_size = inode_length(inode);
+  for (; cnt > 0 && offset < inode_size; cnt--, offset += BLOCK_SECTOR_SIZE) {
+    block_sector_t sector_idx = byte_to_sector(inode, offset);
+    if (sector_idx == (block_sector_t)-1) {
+      break;
+    }
+    buffer_cache_read_ahead(fs_buffer_cache, sector_idx);
+  }
+#endif
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -377,6 +597,7 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
   off_t required_size = offset + size;
   if (required_size > inode->block_data.size) {
     if (inode_data_resize(&inode->block_data, required_size)) { // update inode data
+        inode_map_invalidate(inode);
         inode_writeback(inode); // writeback inode data
     } else {
       wLock_release(&inode->size_lock);
@@ -411,7 +632,7 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
       break;
     }
 #if ENABLE_BUFFER_CACHE
-    buffer_cache_write(fs_buffer_cache, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+    buffer_cache_write(fs_buffer_cache, sector_idx, buffer + bytes_written, sector_ofs, chunk_size, inode_class(inode));
 #else
     if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
       /* Write full sector directly to disk. */
@@ -482,12 +703,18 @@ static struct new_sector_elem {
   int data_block_idx;
   int l1_block_idx;
   int l2_block_idx;
+  block_sector_t l1_block; // new l1 block that starts with this sector, or -1
+  block_sector_t l2_block; // new l2 block that starts with this sector, or -1
   struct list_elem elem;
 } new_sector_elem;
 
-static inline void zero_out(block_sector_t sector) {
+static inline void zero_out(block_sector_t sector, enum buffer_cache_class class) {
   static const char zeros[BLOCK_SECTOR_SIZE];
-  FS_WRITE_BLOCK(zeros, sector);
+#if ENABLE_BUFFER_CACHE
+  buffer_cache_write(fs_buffer_cache, sector, zeros, 0, BLOCK_SECTOR_SIZE, class);
+#else
+  block_write(fs_device, sector, zeros);
+#endif
 }
 
 /* API function for other modules to resizes an inode. Not used by inode.*/
@@ -495,6 +722,7 @@ bool inode_resize(struct inode* a_inode, size_t a_size) {
   wLock_acquire(&a_inode->size_lock);
   bool ret = inode_data_resize(&a_inode->block_data, a_size);
   if (ret == true) {
+    inode_map_invalidate(a_inode);
     struct inode_disk disk_inode;
     inode_writeback(a_inode);
   }
@@ -522,18 +750,33 @@ static bool inode_data_resize(struct inode_data* a_inode_data, size_t a_size) {
   }
 
 
-  for (int i = num_old_sectors; i < num_new_sectors; i++) { //allocate disk space for new sectors
+  // new data is placed right after the current last block if possible, so that the file stays contiguous on disk.
+  block_sector_t goal = num_old_sectors > 0
+    ? inode_data_to_sector(a_inode_data, (num_old_sectors - 1) * BLOCK_SECTOR_SIZE) + 1
+    : 0;
+  block_sector_t extent_sector = 0; // next sector of the current extent
+  size_t extent_left = 0; // sectors of the current extent not handed out yet
+  for (int i = num_old_sectors; i < num_new_sectors; i++) { //allocate disk space for new sectors, one extent at a time
+    if (extent_left == 0) {
+      extent_left = free_map_allocate_extent(num_new_sectors - i, goal, &extent_sector);
+      if (extent_left == 0) { // disk space shortage
+        success = false;
+        goto done;
+      }
+      goal = extent_sector + extent_left;
+    }
     struct new_sector_elem* new_sector = malloc(sizeof(struct new_sector_elem));
     if (new_sector == NULL) { // memory shortage
+      free_map_release(extent_sector, extent_left);
       success = false;
       goto done;
     }
-    if (!free_map_allocate(1, &new_sector->sector)) { // disk space shortage
-      free(new_sector);
-      success = false;
-      goto done;
-    }
-    zero_out(new_sector->sector); // zero out the new sector per convention
+    new_sector->sector = extent_sector++;
+    extent_left--;
+    new_sector->l1_block = -1;
+    new_sector->l2_block = -1;
+    list_push_back(&new_sectors, &new_sector->elem);
+    zero_out(new_sector->sector, a_inode_data->is_dir ? BUFFER_CACHE_META : BUFFER_CACHE_DATA); // zero out the new sector per convention
 
     new_sector->multi_lvl = i >= INODE_DISK_NUM_DIRECT_BLOCKS;
     //Calculate index
@@ -542,13 +785,29 @@ static bool inode_data_resize(struct inode_data* a_inode_data, size_t a_size) {
       new_sector->l2_block_idx = j / INDIRECT_BLOCK_2_CAPACITY_ENTRY; // which l2 block
       new_sector->l1_block_idx = (j % INDIRECT_BLOCK_2_CAPACITY_ENTRY) / INDIRECT_BLOCK_1_CAPACITY_ENTRY; // which l1 block
       new_sector->data_block_idx = j % INDIRECT_BLOCK_1_CAPACITY_ENTRY; // which data block
+      // the indirect blocks are allocated up front too, so that no block is pinned while the free map is searched.
+      if (new_sector->data_block_idx == 0) {
+        if ((new_sector->l1_block_idx == 0 && !free_map_allocate(1, &new_sector->l2_block)) ||
+            !free_map_allocate(1, &new_sector->l1_block)) { // disk space shortage
+          if (extent_left > 0) {
+            free_map_release(extent_sector, extent_left);
+          }
+          success = false;
+          goto done;
+        }
+        if (new_sector->l2_block != (block_sector_t)-1) {
+          zero_out(new_sector->l2_block, BUFFER_CACHE_META);
+        }
+        zero_out(new_sector->l1_block, BUFFER_CACHE_META);
+      }
     } else {
       new_sector->data_block_idx = i;
     }
-    list_push_back(&new_sectors, &new_sector->elem);
   }
 
-  // log new sectors to disk
+  // log new sectors to disk. consecutive new sectors mostly share their l1 block, which stays pinned until they are done.
+  // it is unpinned before the l2 block is pinned, so that only one block is pinned at a time.
+  block_sector_t* l1_block = NULL;
   for (struct list_elem* e = list_begin(&new_sectors); e != list_end(&new_sectors); e = list_next(e)) {
     struct new_sector_elem* new_sector = list_entry(e, struct new_sector_elem, elem);
     int l1_block_idx = new_sector->l1_block_idx;
@@ -556,31 +815,30 @@ static bool inode_data_resize(struct inode_data* a_inode_data, size_t a_size) {
     int data_block_idx = new_sector->data_block_idx;
     
     if (new_sector->multi_lvl) {
-      if (l1_block_idx == 0 && new_sector->data_block_idx == 0) { //need to allocate a new l2 block
-        block_sector_t l2_block_sector;
-        if (!free_map_allocate(1, &l2_block_sector)) { // disk space shortage
-          success = false;
-          break;
-        }
-        a_inode_data->l2_blocks[l2_block_idx] = l2_block_sector;
+      if (new_sector->l2_block != (block_sector_t)-1) {
+        a_inode_data->l2_blocks[l2_block_idx] = new_sector->l2_block;
       }
-      if (data_block_idx == 0) { //need to allocate a new l1 block
-        block_sector_t l1_block_sector;
-        if (!free_map_allocate(1, &l1_block_sector)) { // disk space shortage
-          success = false;
-          break;
+      if (l1_block == NULL || data_block_idx == 0) { // moving on to another l1 block
+        if (l1_block != NULL) {
+          buffer_cache_put(fs_buffer_cache, l1_block, true);
         }
-        buffer_cache_write(fs_buffer_cache, a_inode_data->l2_blocks[l2_block_idx], &l1_block_sector, l1_block_idx * sizeof(block_sector_t), sizeof(block_sector_t));
-      }    
-      //find the l1 block
-      block_sector_t l1_block_sector;
-      buffer_cache_read(fs_buffer_cache, a_inode_data->l2_blocks[l2_block_idx], &l1_block_sector, l1_block_idx * sizeof(block_sector_t), sizeof(block_sector_t));
+        block_sector_t* l2_block = buffer_cache_get(fs_buffer_cache, a_inode_data->l2_blocks[l2_block_idx], data_block_idx == 0, BUFFER_CACHE_META);
+        if (data_block_idx == 0) {
+          l2_block[l1_block_idx] = new_sector->l1_block;
+        }
+        block_sector_t sector = l2_block[l1_block_idx];
+        buffer_cache_put(fs_buffer_cache, l2_block, data_block_idx == 0);
+        l1_block = buffer_cache_get(fs_buffer_cache, sector, true, BUFFER_CACHE_META);
+      }
       //write the new sector into the l1 block
-      buffer_cache_write(fs_buffer_cache, l1_block_sector, &new_sector->sector, data_block_idx * sizeof(block_sector_t), sizeof(block_sector_t));
+      l1_block[data_block_idx] = new_sector->sector;
     } else {
       a_inode_data->l0_blocks[data_block_idx] = new_sector->sector;
     }
   }
+  if (l1_block != NULL) {
+    buffer_cache_put(fs_buffer_cache, l1_block, true);
+  }
 
   success = true;
 done:
@@ -590,6 +848,12 @@ done:
     struct new_sector_elem* new_sector = list_entry(e, struct new_sector_elem, elem);
     if (!success) {
       free_map_release(new_sector->sector, 1);
+      if (new_sector->l1_block != (block_sector_t)-1) {
+        free_map_release(new_sector->l1_block, 1);
+      }
+      if (new_sector->l2_block != (block_sector_t)-1) {
+        free_map_release(new_sector->l2_block, 1);
+      }
     }
     free(new_sector);
   }
@@ -603,6 +867,22 @@ bool inode_is_dir(struct inode* a_inode) {
   return a_inode->block_data.is_dir;
 }
 
+/* Returns true if the directory A_INODE uses the hashed directory format.*/
+bool inode_is_hashed(struct inode* a_inode) {
+  return a_inode->block_data.is_hashed;
+}
+
+/* Lock the entries of the directory A_INODE, exclusively if A_WRITE. The lock is shared by all openers of A_INODE.*/
+void inode_dir_lock_acquire(struct inode* a_inode, bool a_write) {
+  ASSERT(a_inode->block_data.is_dir);
+  rw_lock_acquire(&a_inode->dir_lock, !a_write);
+}
+
+/* Release a lock taken by inode_dir_lock_acquire() with the same A_WRITE.*/
+void inode_dir_lock_release(struct inode* a_inode, bool a_write) {
+  rw_lock_release(&a_inode->dir_lock, !a_write);
+}
+
 int inode_get_open_cnt(struct inode* a_inode) {
   ASSERT(a_inode != NULL);
   return a_inode->open_cnt;
@@ -8,8 +8,13 @@
 
 struct bitmap;
 
+#define INODE_CACHE_DEFAULT_SIZE 64 /* Number of closed inodes kept in memory unless overridden by "-icache=N". */
+
+/* Maximum number of closed inodes kept in memory. Set from the kernel command line. */
+extern size_t inode_cache_size;
+
 void inode_init(void);
-bool inode_create(block_sector_t, off_t, bool);
+bool inode_create(block_sector_t, off_t, bool is_directory, bool is_hashed);
 struct inode* inode_open(block_sector_t);
 struct inode* inode_reopen(struct inode*);
 block_sector_t inode_get_inumber(const struct inode*);
@@ -17,11 +22,17 @@ void inode_close(struct inode*);
 void inode_remove(struct inode*);
 off_t inode_read_at(struct inode*, void*, off_t size, off_t offset);
 off_t inode_write_at(struct inode*, const void*, off_t size, off_t offset);
+const void* inode_get_block(struct inode*, off_t offset);
+void inode_put_block(const void*);
+void inode_read_ahead(struct inode*, off_t offset, size_t cnt);
 void inode_deny_write(struct inode*);
 void inode_allow_write(struct inode*);
 off_t inode_length(const struct inode*);
 
 bool inode_is_dir(struct inode* inode);
+bool inode_is_hashed(struct inode* inode);
+void inode_dir_lock_acquire(struct inode* inode, bool write);
+void inode_dir_lock_release(struct inode* inode, bool write);
 int inode_get_open_cnt(struct inode* inode);
 
 bool inode_resize(struct inode* inode, size_t new_size);
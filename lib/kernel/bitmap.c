@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -284,6 +285,19 @@ bool bitmap_write(const struct bitmap* b, struct file* file) {
   off_t size = byte_cnt(b->bit_cnt);
   return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Copies SIZE bytes of B's file image, starting at byte OFS,
+   into DST, so that they can be written to the same place in a
+   file later on.  The range is clipped to the end of the image.
+   Returns the number of bytes copied. */
+size_t bitmap_copy_file_image(const struct bitmap* b, size_t ofs, size_t size, void* dst) {
+  size_t total = byte_cnt(b->bit_cnt);
+  ASSERT(ofs <= total);
+  if (size > total - ofs)
+    size = total - ofs;
+  memcpy(dst, (const uint8_t*)b->bits + ofs, size);
+  return size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -43,7 +43,9 @@ enum {
   SYS_INUMBER,  /* Returns the inode number for a fd. */
   SYS_FILESYS_GET_READ_WRITE_COUNT, /* Returns the number of blocks read and written */
   SYS_CACHE_GET_HIT_MISS_TIME, /* Returns the cache hit and miss time */
-  SYS_CACHE_RESET /* Resets the buffer cache */
+  SYS_CACHE_RESET, /* Resets the buffer cache */
+  SYS_CACHE_GET_PREFETCH_STATS, /* Returns the number of prefetched sectors and how many of them were used */
+  SYS_CACHE_GET_CLASS_STATS /* Returns the cache hit and miss time of metadata or of file data */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -1,6 +1,7 @@
 #include <syscall.h>
 #include "../syscall-nr.h"
 #include <pthread.h>
+#include <stddef.h>
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
@@ -162,9 +163,25 @@ tid_t get_tid(void) { return syscall0(SYS_GET_TID); }
 void cache_reset(void) { return syscall0(SYS_CACHE_RESET); }
 
 void cache_get_hit_miss_time(int* hitRet, int* missRet) {
-  syscall2(SYS_CACHE_GET_HIT_MISS_TIME, hitRet, missRet);
+  syscall3(SYS_CACHE_GET_HIT_MISS_TIME, hitRet, missRet, NULL);
+}
+
+void cache_get_hit_miss_size(int* hitRet, int* missRet, int* sizeRet) {
+  syscall3(SYS_CACHE_GET_HIT_MISS_TIME, hitRet, missRet, sizeRet);
+}
+
+void cache_get_prefetch_stats(int* prefetchRet, int* prefetchHitRet) {
+  syscall2(SYS_CACHE_GET_PREFETCH_STATS, prefetchRet, prefetchHitRet);
+}
+
+void cache_get_class_stats(bool metadata, int* hitRet, int* missRet) {
+  syscall3(SYS_CACHE_GET_CLASS_STATS, metadata, hitRet, missRet);
 }
 
 void filesys_get_read_write_count(unsigned long long* read_count, unsigned long long* write_count) {
-  syscall2(SYS_FILESYS_GET_READ_WRITE_COUNT, read_count, write_count);
+  syscall3(SYS_FILESYS_GET_READ_WRITE_COUNT, read_count, write_count, NULL);
+}
+
+void filesys_get_free_map_stats(unsigned long long* read_count, unsigned long long* write_count, unsigned long long* free_map_write_count) {
+  syscall3(SYS_FILESYS_GET_READ_WRITE_COUNT, read_count, write_count, free_map_write_count);
 }
\ No newline at end of file
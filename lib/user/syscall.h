@@ -64,7 +64,11 @@ int inumber(int fd);
 
 // Project 4 debugging syscalls
 void filesys_get_read_write_count(unsigned long long* read_count, unsigned long long* write_count);
+void filesys_get_free_map_stats(unsigned long long* read_count, unsigned long long* write_count, unsigned long long* free_map_write_count);
 void cache_get_hit_miss_time(int* hitRet, int* missRet);
+void cache_get_hit_miss_size(int* hitRet, int* missRet, int* sizeRet);
 void cache_reset(void);
+void cache_get_prefetch_stats(int* prefetchRet, int* prefetchHitRet);
+void cache_get_class_stats(bool metadata, int* hitRet, int* missRet);
 
 #endif /* lib/user/syscall.h */
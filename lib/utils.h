@@ -1,4 +1,5 @@
 #pragma once
+#include <round.h>
 #include <stdio.h>
 #include "userprog/process.h"
 /*Bunch of useful functions*/
@@ -52,5 +53,4 @@ void wLock_release(rwLock* a_lock);
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 #define MIN3(a,b,c) MIN(MIN(a,b),c)
-#define DIV_ROUND_UP(n,d) (((n) + (d) - 1) / (d))
 #pragma endregion
\ No newline at end of file
@@ -39,8 +39,10 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "filesys/buffer_cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -129,7 +131,7 @@ int main(void) {
   struct thread* t = thread_current();
   list_init(&t->pcb->l_children); /*initialize children list for main thread*/
   list_init(&t->pcb->l_sharedData);//TODO: encapsulate this in a function
-  list_init(&t->pcb->fdt);
+  L_fdt_init(&t->pcb->fdt);
   list_init(&active_procs);
 #endif
 #if FPU_ENABLE
@@ -255,6 +257,50 @@ static char** parse_options(char** argv) {
       filesys_bdev_name = value;
     else if (!strcmp(name, "-scratch"))
       scratch_bdev_name = value;
+    else if (!strcmp(name, "-bcache")) {
+      int size = value != NULL ? atoi(value) : 0;
+      if (size <= 0)
+        PANIC("invalid buffer cache size `%s' (use -h for help)", value);
+      buffer_cache_size = size;
+    }
+    else if (!strcmp(name, "-bcache-age")) {
+      int age = value != NULL ? atoi(value) : 0;
+      if (age <= 0)
+        PANIC("invalid buffer cache dirty age `%s' (use -h for help)", value);
+      buffer_cache_dirty_age = age;
+    }
+    else if (!strcmp(name, "-bcache-dirty")) {
+      int limit = value != NULL ? atoi(value) : 0;
+      if (limit <= 0)
+        PANIC("invalid buffer cache dirty limit `%s' (use -h for help)", value);
+      buffer_cache_dirty_limit = limit;
+    }
+    else if (!strcmp(name, "-bcache-meta")) {
+      int reserve = value != NULL ? atoi(value) : 0;
+      if (reserve <= 0)
+        PANIC("invalid buffer cache metadata reserve `%s' (use -h for help)", value);
+      buffer_cache_meta_reserve = reserve;
+    }
+    else if (!strcmp(name, "-icache")) {
+      int size = value != NULL ? atoi(value) : -1;
+      if (size < 0)
+        PANIC("invalid inode cache size `%s' (use -h for help)", value);
+      inode_cache_size = size;
+    }
+    else if (!strcmp(name, "-bcache-policy")) {
+      if (value == NULL)
+        PANIC("missing buffer cache policy (use -h for help)");
+      else if (!strcmp(value, "lru"))
+        buffer_cache_policy = BUFFER_CACHE_POLICY_LRU;
+      else if (!strcmp(value, "clock"))
+        buffer_cache_policy = BUFFER_CACHE_POLICY_CLOCK;
+      else if (!strcmp(value, "2q"))
+        buffer_cache_policy = BUFFER_CACHE_POLICY_2Q;
+      else if (!strcmp(value, "arc"))
+        buffer_cache_policy = BUFFER_CACHE_POLICY_ARC;
+      else
+        PANIC("unknown buffer cache policy `%s' (use -h for help)", value);
+    }
 #ifdef VM
     else if (!strcmp(name, "-swap"))
       swap_bdev_name = value;
@@ -435,6 +481,12 @@ static void usage(void) {
          "  -f                 Format file system device during startup.\n"
          "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
          "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+         "  -bcache=N          Cache N sectors in the file system buffer cache.\n"
+         "  -bcache-age=TICKS  Write back cached sectors dirty for TICKS timer ticks.\n"
+         "  -bcache-dirty=N    Write back cached sectors while more than N are dirty.\n"
+         "  -bcache-meta=N     Keep up to N cached metadata sectors from being evicted by file data.\n"
+         "  -bcache-policy=P   Replace cached sectors by P: lru (default), clock, 2q or arc.\n"
+         "  -icache=N          Keep up to N closed inodes in memory; 0 disables.\n"
 #ifdef VM
          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif // VM
@@ -32,6 +32,10 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Maximum length of a chain of locks that priority is donated
+   through, bounding the work done by lock_acquire(). */
+#define DONATION_DEPTH_MAX 8
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -93,7 +97,8 @@ bool sema_try_down(struct semaphore* sema) {
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.
 
    This function may be called from an interrupt handler. */
 void sema_up(struct semaphore* sema) {
@@ -102,10 +107,16 @@ void sema_up(struct semaphore* sema) {
   ASSERT(sema != NULL);
 
   old_level = intr_disable();
-  if (!list_empty(&sema->waiters))
-    thread_unblock(list_entry(list_pop_front(&sema->waiters), struct thread, elem));
+  if (!list_empty(&sema->waiters)) {
+    struct list_elem* e = list_max(&sema->waiters, thread_priority_less, NULL);
+    list_remove(e);
+    thread_unblock(list_entry(e, struct thread, elem));
+  }
   sema->value++;
   intr_set_level(old_level);
+
+  if (old_level == INTR_ON || intr_context())
+    thread_preempt();
 }
 
 static void sema_test_helper(void* sema_);
@@ -165,6 +176,10 @@ void lock_init(struct lock* lock) {
    necessary.  The lock must not already be held by the current
    thread.
 
+   While sleeping, the current thread donates its priority to
+   the holder, and on through the chain of locks the holder is
+   itself waiting for, up to DONATION_DEPTH_MAX levels deep.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -174,8 +189,23 @@ void lock_acquire(struct lock* lock) {
   ASSERT(!intr_context());
   ASSERT(!lock_held_by_current_thread(lock));
 
+  enum intr_level old_level = intr_disable();
+  struct thread* cur = thread_current();
+  if (lock->holder != NULL) {
+    struct lock* l = lock;
+    cur->waiting_lock = lock;
+    for (int depth = 0; l != NULL && l->holder != NULL && depth < DONATION_DEPTH_MAX; depth++) {
+      if (l->holder->priority >= cur->priority)
+        break;
+      thread_donate_priority(l->holder, cur->priority);
+      l = l->holder->waiting_lock;
+    }
+  }
   sema_down(&lock->semaphore);
-  lock->holder = thread_current();
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  list_push_back(&cur->held_locks, &lock->elem);
+  intr_set_level(old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -191,12 +221,18 @@ bool lock_try_acquire(struct lock* lock) {
   ASSERT(!lock_held_by_current_thread(lock));
 
   success = sema_try_down(&lock->semaphore);
-  if (success)
+  if (success) {
+    enum intr_level old_level = intr_disable();
     lock->holder = thread_current();
+    list_push_back(&lock->holder->held_locks, &lock->elem);
+    intr_set_level(old_level);
+  }
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Priority donated through LOCK is given back, which may let a
+   waiter preempt the current thread.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -205,8 +241,15 @@ void lock_release(struct lock* lock) {
   ASSERT(lock != NULL);
   ASSERT(lock_held_by_current_thread(lock));
 
+  enum intr_level old_level = intr_disable();
   lock->holder = NULL;
+  list_remove(&lock->elem);
+  thread_refresh_priority(thread_current());
   sema_up(&lock->semaphore);
+  intr_set_level(old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -280,8 +323,16 @@ void rw_lock_release(struct rw_lock* rw_lock, bool reader) {
 struct semaphore_elem {
   struct list_elem elem;      /* List element. */
   struct semaphore semaphore; /* This semaphore. */
+  struct thread* thread;      /* Thread waiting on SEMAPHORE. */
 };
 
+/* Orders condition variable waiters by their thread's effective priority. */
+static bool semaphore_elem_less(const struct list_elem* a, const struct list_elem* b,
+                                void* aux UNUSED) {
+  return list_entry(a, struct semaphore_elem, elem)->thread->priority <
+         list_entry(b, struct semaphore_elem, elem)->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -320,6 +371,7 @@ void cond_wait(struct condition* cond, struct lock* lock) {
   ASSERT(lock_held_by_current_thread(lock));
 
   sema_init(&waiter.semaphore, 0);
+  waiter.thread = thread_current();
   list_push_back(&cond->waiters, &waiter.elem);
   lock_release(lock);
   sema_down(&waiter.semaphore);
@@ -327,7 +379,8 @@ void cond_wait(struct condition* cond, struct lock* lock) {
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one of them to wake
+   up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -339,8 +392,11 @@ void cond_signal(struct condition* cond, struct lock* lock UNUSED) {
   ASSERT(!intr_context());
   ASSERT(lock_held_by_current_thread(lock));
 
-  if (!list_empty(&cond->waiters))
-    sema_up(&list_entry(list_pop_front(&cond->waiters), struct semaphore_elem, elem)->semaphore);
+  if (!list_empty(&cond->waiters)) {
+    struct list_elem* e = list_max(&cond->waiters, semaphore_elem_less, NULL);
+    list_remove(e);
+    sema_up(&list_entry(e, struct semaphore_elem, elem)->semaphore);
+  }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -18,8 +18,9 @@ void sema_self_test(void);
 
 /* Lock. */
 struct lock {
-  struct thread* holder;      /* Thread holding lock (for debugging). */
+  struct thread* holder;      /* Thread holding lock. */
   struct semaphore semaphore; /* Binary semaphore controlling access. */
+  struct list_elem elem;      /* Element in the holder's held_locks list. */
 };
 
 void lock_init(struct lock*);
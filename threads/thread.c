@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -24,6 +25,28 @@
    that are ready to run but not actually running. */
 static struct list fifo_ready_list;
 
+/* Ready queues of the strict priority and MLFQS schedulers: one
+   FIFO per priority, and a bitmap with bit P set iff
+   prio_ready_queues[P] is non-empty, so the highest ready
+   priority is a find-first-set away. */
+#define PRIO_MASK_WORDS ((PRI_MAX + 32) / 32)
+static struct list prio_ready_queues[PRI_MAX + 1];
+static uint32_t prio_ready_mask[PRIO_MASK_WORDS];
+static size_t prio_ready_cnt; /* # of threads in prio_ready_queues. */
+
+/* True if the active policy schedules from prio_ready_queues. */
+#define PRIO_QUEUES_ACTIVE() (active_sched_policy == SCHED_PRIO || active_sched_policy == SCHED_MLFQS)
+
+/* System load average estimate, maintained under "-sched=mlfqs". */
+static fixed_point_t load_avg;
+
+/* Ready threads of the fair scheduler, a skew heap with the
+   smallest vruntime at the root, and a lower bound on the
+   vruntime of every runnable thread.  fair_min_vruntime only
+   grows. */
+static struct thread* fair_ready_heap;
+static int64_t fair_min_vruntime;
+
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
@@ -53,6 +76,13 @@ static long long user_ticks;   /* # of timer ticks in user programs. */
 #define TIME_SLICE 4          /* # of timer ticks to give each thread. */
 static unsigned thread_ticks; /* # of timer ticks since last yield. */
 
+/* Fair scheduling.  A PRI_DEFAULT thread's vruntime advances by
+   FAIR_TICK_VRUNTIME per tick; a thread with priority P advances
+   at (PRI_DEFAULT + 1) / (P + 1) times that rate. */
+#define FAIR_TICK_VRUNTIME 1024
+#define FAIR_SLEEPER_CREDIT (FAIR_TICK_VRUNTIME * TIME_SLICE) /* Max vruntime lead on wakeup. */
+#define FAIR_WAKEUP_GRANULARITY FAIR_TICK_VRUNTIME /* Lead needed to preempt on wakeup. */
+
 static void init_thread(struct thread*, const char* name, int priority);
 static bool is_thread(struct thread*) UNUSED;
 static void* alloc_frame(struct thread*, size_t size);
@@ -71,6 +101,14 @@ static struct thread* thread_schedule_prio(void);
 static struct thread* thread_schedule_fair(void);
 static struct thread* thread_schedule_mlfqs(void);
 static struct thread* thread_schedule_reserved(void);
+static int prio_ready_max(void);
+static void prio_dequeue(struct thread* t);
+static void thread_set_effective_priority(struct thread* t, int priority);
+static int mlfqs_priority(struct thread* t);
+static void mlfqs_update_priority(struct thread* t);
+static void mlfqs_tick(struct thread* cur);
+static struct thread* fair_merge(struct thread* a, struct thread* b);
+static void fair_charge(struct thread* t);
 
 /* Determines which scheduler the kernel should use.
    Controlled by the kernel command-line options
@@ -108,6 +146,8 @@ void thread_init(void) {
 
   lock_init(&tid_lock);
   list_init(&fifo_ready_list);
+  for (int i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init(&prio_ready_queues[i]);
   list_init(&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -147,6 +187,11 @@ void thread_tick(void) {
   else
     kernel_ticks++;
 
+  if (active_sched_policy == SCHED_MLFQS)
+    mlfqs_tick(t);
+  else if (active_sched_policy == SCHED_FAIR && t != idle_thread)
+    fair_charge(t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return();
@@ -170,9 +215,8 @@ void thread_print_stats(void) {
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   Under "-sched=prio", a new thread with a higher PRIORITY than
+   the running one preempts it before thread_create() returns. */
 tid_t thread_create(const char* name, int priority, thread_func* function, void* aux) {
   struct thread* t;
   struct kernel_thread_frame* kf;
@@ -191,6 +235,15 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
   init_thread(t, name, priority);
   tid = t->tid = allocate_tid();
 
+  /* Under MLFQS, the new thread inherits its parent's nice and
+     recent_cpu and PRIORITY is ignored. */
+  if (active_sched_policy == SCHED_MLFQS) {
+    struct thread* parent = thread_current();
+    t->nice = parent->nice;
+    t->recent_cpu = parent->recent_cpu;
+    t->priority = t->base_priority = mlfqs_priority(t);
+  }
+
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame(t, sizeof *kf);
   kf->eip = NULL;
@@ -238,7 +291,23 @@ static void thread_enqueue(struct thread* t) {
 
   if (active_sched_policy == SCHED_FIFO)
     list_push_back(&fifo_ready_list, &t->elem);
-  else
+  else if (PRIO_QUEUES_ACTIVE()) {
+    list_push_back(&prio_ready_queues[t->priority], &t->elem);
+    prio_ready_mask[t->priority / 32] |= 1u << (t->priority % 32);
+    prio_ready_cnt++;
+  } else if (active_sched_policy == SCHED_FAIR) {
+    /* A thread back from sleep starts at most FAIR_SLEEPER_CREDIT
+       behind the others, rather than owning the CPU until it has
+       caught up with them. */
+    if (t->vruntime < fair_min_vruntime - FAIR_SLEEPER_CREDIT)
+      t->vruntime = fair_min_vruntime - FAIR_SLEEPER_CREDIT;
+    t->fair_left = t->fair_right = NULL;
+    fair_ready_heap = fair_merge(fair_ready_heap, t);
+#ifdef USERPROG
+    if (t->pcb != NULL)
+      t->pcb->fair_queued_cnt++;
+#endif
+  } else
     PANIC("Unimplemented scheduling policy value: %d", active_sched_policy);
 }
 
@@ -246,10 +315,11 @@ static void thread_enqueue(struct thread* t) {
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T should preempt the running thread, this function yields
+   (or, in an interrupt handler, yields on return), except when
+   the caller had disabled interrupts itself: it may expect that
+   it can atomically unblock a thread and update other data, and
+   should call thread_preempt() once interrupts are back on. */
 void thread_unblock(struct thread* t) {
   enum intr_level old_level;
 
@@ -260,6 +330,31 @@ void thread_unblock(struct thread* t) {
   thread_enqueue(t);
   t->status = THREAD_READY;
   intr_set_level(old_level);
+
+  if (old_level == INTR_ON || intr_context())
+    thread_preempt();
+}
+
+/* Yields the CPU if a ready thread should run instead of the
+   running one under the active scheduling policy.  In an
+   interrupt handler, the yield happens when the handler returns. */
+void thread_preempt(void) {
+  enum intr_level old_level = intr_disable();
+  struct thread* cur = running_thread();
+  bool preempt = false;
+  if (PRIO_QUEUES_ACTIVE())
+    preempt = prio_ready_max() > (cur == idle_thread ? PRI_MIN - 1 : cur->priority);
+  else if (active_sched_policy == SCHED_FAIR && fair_ready_heap != NULL)
+    preempt = cur == idle_thread ||
+              fair_ready_heap->vruntime + FAIR_WAKEUP_GRANULARITY < cur->vruntime;
+  intr_set_level(old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context())
+    intr_yield_on_return();
+  else
+    thread_yield();
 }
 
 /* Returns the name of the running thread. */
@@ -330,32 +425,160 @@ void thread_foreach(thread_action_func* func, void* aux) {
   }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
-void thread_set_priority(int new_priority) { thread_current()->priority = new_priority; }
+/* Sets the current thread's base priority to NEW_PRIORITY,
+   yielding if a ready thread now has a higher priority.  The
+   effective priority stays raised while donations exceed it.
+   Ignored under MLFQS, which computes priorities itself. */
+void thread_set_priority(int new_priority) {
+  ASSERT(PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+  if (active_sched_policy == SCHED_MLFQS)
+    return;
+  enum intr_level old_level = intr_disable();
+  struct thread* cur = thread_current();
+  cur->base_priority = new_priority;
+  thread_refresh_priority(cur);
+  intr_set_level(old_level);
+  thread_preempt();
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching ready queue if it is ready.  Interrupts must be off. */
+static void thread_set_effective_priority(struct thread* t, int priority) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY && PRIO_QUEUES_ACTIVE()) {
+    prio_dequeue(t);
+    t->priority = priority;
+    thread_enqueue(t);
+  } else
+    t->priority = priority;
+}
+
+/* Raises T's effective priority to PRIORITY if it is lower, on
+   behalf of a thread waiting for a lock T holds.  Interrupts
+   must be off.  MLFQS does not donate. */
+void thread_donate_priority(struct thread* t, int priority) {
+  ASSERT(is_thread(t));
+  if (active_sched_policy != SCHED_MLFQS && priority > t->priority)
+    thread_set_effective_priority(t, priority);
+}
+
+/* Recomputes T's effective priority as the maximum of its base
+   priority and the priorities of the waiters of every lock it
+   holds.  Interrupts must be off. */
+void thread_refresh_priority(struct thread* t) {
+  struct list_elem* e;
+  int priority = t->base_priority;
+
+  ASSERT(is_thread(t));
+  if (active_sched_policy == SCHED_MLFQS) {
+    thread_set_effective_priority(t, priority);
+    return;
+  }
+  for (e = list_begin(&t->held_locks); e != list_end(&t->held_locks); e = list_next(e)) {
+    struct list* waiters = &list_entry(e, struct lock, elem)->semaphore.waiters;
+    if (!list_empty(waiters)) {
+      struct thread* w = list_entry(list_max(waiters, thread_priority_less, NULL), struct thread, elem);
+      if (w->priority > priority)
+        priority = w->priority;
+    }
+  }
+  thread_set_effective_priority(t, priority);
+}
+
+/* Orders threads linked through `elem' by effective priority. */
+bool thread_priority_less(const struct list_elem* a, const struct list_elem* b,
+                          void* aux UNUSED) {
+  return list_entry(a, struct thread, elem)->priority < list_entry(b, struct thread, elem)->priority;
+}
 
 /* Returns the current thread's priority. */
 int thread_get_priority(void) { return thread_current()->priority; }
 
-/* Sets the current thread's nice value to NICE. */
-void thread_set_nice(int nice UNUSED) { /* Not yet implemented. */
+/* Sets the current thread's nice value to NICE, clamped to
+   [NICE_MIN, NICE_MAX], and recomputes its MLFQS priority,
+   yielding if it no longer has the highest priority. */
+void thread_set_nice(int nice) {
+  enum intr_level old_level = intr_disable();
+  struct thread* cur = thread_current();
+  cur->nice = nice < NICE_MIN ? NICE_MIN : nice > NICE_MAX ? NICE_MAX : nice;
+  if (active_sched_policy == SCHED_MLFQS)
+    mlfqs_update_priority(cur);
+  intr_set_level(old_level);
+  thread_preempt();
 }
 
 /* Returns the current thread's nice value. */
-int thread_get_nice(void) {
-  /* Not yet implemented. */
-  return 0;
-}
+int thread_get_nice(void) { return thread_current()->nice; }
 
 /* Returns 100 times the system load average. */
 int thread_get_load_avg(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int load = fix_round(fix_scale(load_avg, 100));
+  intr_set_level(old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int thread_get_recent_cpu(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int recent_cpu = fix_round(fix_scale(thread_current()->recent_cpu, 100));
+  intr_set_level(old_level);
+  return recent_cpu;
+}
+
+/* Returns T's MLFQS priority,
+   PRI_MAX - recent_cpu / 4 - nice * 2, clamped to the valid range. */
+static int mlfqs_priority(struct thread* t) {
+  int priority = fix_trunc(fix_sub(fix_int(PRI_MAX - t->nice * 2), fix_unscale(t->recent_cpu, 4)));
+  return priority < PRI_MIN ? PRI_MIN : priority > PRI_MAX ? PRI_MAX : priority;
+}
+
+/* Recomputes T's MLFQS priority, moving T to its new ready
+   queue if it changed.  Interrupts must be off. */
+static void mlfqs_update_priority(struct thread* t) {
+  t->base_priority = mlfqs_priority(t);
+  thread_set_effective_priority(t, t->base_priority);
+}
+
+/* Decays T's recent_cpu by the factor pointed to by COEF_ and
+   adds its nice value, as done once per second.  Only threads
+   whose recent_cpu actually changed have their priority
+   recomputed. */
+static void mlfqs_decay(struct thread* t, void* coef_) {
+  fixed_point_t* coef = coef_;
+  if (t == idle_thread)
+    return;
+  fixed_point_t recent_cpu = fix_add(fix_mul(*coef, t->recent_cpu), fix_int(t->nice));
+  if (recent_cpu.f != t->recent_cpu.f) {
+    t->recent_cpu = recent_cpu;
+    mlfqs_update_priority(t);
+  }
+}
+
+/* MLFQS bookkeeping for one timer tick, with CUR the running
+   thread.  CUR is charged the tick; once per second load_avg is
+   updated and every thread's recent_cpu decays; every time slice
+   CUR, the only thread whose recent_cpu grew, gets its priority
+   recomputed.  Runs in the timer interrupt. */
+static void mlfqs_tick(struct thread* cur) {
+  int64_t now = timer_ticks();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fix_add(cur->recent_cpu, fix_int(1));
+
+  if (now % TIMER_FREQ == 0) {
+    int ready_cnt = prio_ready_cnt + (cur != idle_thread ? 1 : 0);
+    load_avg = fix_add(fix_mul(fix_frac(59, 60), load_avg), fix_scale(fix_frac(1, 60), ready_cnt));
+    fixed_point_t twice_load = fix_scale(load_avg, 2);
+    fixed_point_t coef = fix_div(twice_load, fix_add(twice_load, fix_int(1)));
+    thread_foreach(mlfqs_decay, &coef);
+  }
+  if (now % TIME_SLICE == 0 && cur != idle_thread)
+    mlfqs_update_priority(cur);
+
+  thread_preempt();
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -430,7 +653,11 @@ static void init_thread(struct thread* t, const char* name, int priority) {
   t->status = THREAD_BLOCKED;
   strlcpy(t->name, name, sizeof t->name);
   t->stack = (uint8_t*)t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init(&t->held_locks);
+  t->waiting_lock = NULL;
+  if (active_sched_policy == SCHED_MLFQS)
+    t->priority = t->base_priority = mlfqs_priority(t);
   t->pcb = NULL;
   t->magic = THREAD_MAGIC;
 
@@ -459,21 +686,91 @@ static struct thread* thread_schedule_fifo(void) {
     return idle_thread;
 }
 
-/* Strict priority scheduler */
+/* Removes ready thread T from prio_ready_queues. */
+static void prio_dequeue(struct thread* t) {
+  struct list* queue = &prio_ready_queues[t->priority];
+  list_remove(&t->elem);
+  if (list_empty(queue))
+    prio_ready_mask[t->priority / 32] &= ~(1u << (t->priority % 32));
+  prio_ready_cnt--;
+}
+
+/* Returns the highest priority with a ready thread in
+   prio_ready_queues, or PRI_MIN - 1 if there is none. */
+static int prio_ready_max(void) {
+  for (int i = PRIO_MASK_WORDS - 1; i >= 0; i--)
+    if (prio_ready_mask[i] != 0)
+      return i * 32 + 31 - __builtin_clz(prio_ready_mask[i]);
+  return PRI_MIN - 1;
+}
+
+/* Strict priority scheduler, round-robin within a priority */
 static struct thread* thread_schedule_prio(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=prio\"");
+  int priority = prio_ready_max();
+  if (priority < PRI_MIN)
+    return idle_thread;
+
+  struct thread* t = list_entry(list_front(&prio_ready_queues[priority]), struct thread, elem);
+  prio_dequeue(t);
+  return t;
 }
 
-/* Fair priority scheduler */
-static struct thread* thread_schedule_fair(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=fair\"");
+/* Merges fair scheduler heaps A and B and returns the new root,
+   the same top-down skew heap merge as timer.c's sleep queue. */
+static struct thread* fair_merge(struct thread* a, struct thread* b) {
+  struct thread* root = NULL;
+  struct thread** link = &root;
+  while (a != NULL && b != NULL) {
+    if (b->vruntime < a->vruntime) {
+      struct thread* tmp = a;
+      a = b;
+      b = tmp;
+    }
+    struct thread* right = a->fair_right;
+    a->fair_right = a->fair_left;
+    *link = a;
+    link = &a->fair_left;
+    a = right;
+  }
+  *link = a != NULL ? a : b;
+  return root;
 }
 
-/* Multi-level feedback queue scheduler */
-static struct thread* thread_schedule_mlfqs(void) {
-  PANIC("Unimplemented scheduler policy: \"-sched=mlfqs\"");
+/* Charges running thread T for one tick under the fair scheduler.
+   The charge is weighted by T's priority, and multiplied by the
+   number of runnable threads in T's process so that a process
+   with many threads gets about the share of a single one. */
+static void fair_charge(struct thread* t) {
+  int64_t delta = FAIR_TICK_VRUNTIME * (PRI_DEFAULT + 1) / (t->priority + 1);
+#ifdef USERPROG
+  if (t->pcb != NULL)
+    delta *= 1 + t->pcb->fair_queued_cnt;
+#endif
+  t->vruntime += delta;
 }
 
+/* Fair scheduler: runs the ready thread with the least vruntime,
+   in O(log n) amortized. */
+static struct thread* thread_schedule_fair(void) {
+  struct thread* t = fair_ready_heap;
+  if (t == NULL)
+    return idle_thread;
+
+  fair_ready_heap = fair_merge(t->fair_left, t->fair_right);
+#ifdef USERPROG
+  if (t->pcb != NULL)
+    t->pcb->fair_queued_cnt--;
+#endif
+  if (t->vruntime > fair_min_vruntime)
+    fair_min_vruntime = t->vruntime;
+  return t;
+}
+
+/* Multi-level feedback queue scheduler.  Priorities are
+   recomputed by mlfqs_tick(), so picking the next thread is the
+   same as for the strict priority scheduler. */
+static struct thread* thread_schedule_mlfqs(void) { return thread_schedule_prio(); }
+
 /* Not an actual scheduling policy — placeholder for empty
  * slots in the scheduler jump table. */
 static struct thread* thread_schedule_reserved(void) {
@@ -26,6 +26,10 @@ typedef int tid_t;
 #define PRI_DEFAULT 31 /* Default priority. */
 #define PRI_MAX 63     /* Highest priority. */
 
+/* Thread nice values, used by "-sched=mlfqs". */
+#define NICE_MIN -20 /* Nicest to other threads. */
+#define NICE_MAX 20  /* Least nice to other threads. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -88,11 +92,28 @@ struct thread {
   enum thread_status status; /* Thread state. */
   char name[16];             /* Name (for debugging purposes). */
   uint8_t* stack;            /* Saved stack pointer. */
-  int priority;              /* Priority. */
+  int priority;              /* Effective priority, including donations. */
   struct list_elem allelem;  /* List element for all threads list. */
 
   /* Shared between thread.c and synch.c. */
-  struct list_elem elem; /* List element. */
+  struct list_elem elem;     /* List element. */
+  int base_priority;         /* Priority set by the thread itself, before donations. */
+  struct list held_locks;    /* Locks held, whose waiters donate their priority. */
+  struct lock* waiting_lock; /* Lock this thread is blocked on, or NULL. */
+
+  /* Owned by thread.c, used by "-sched=mlfqs". */
+  int nice;                  /* Niceness, NICE_MIN to NICE_MAX. */
+  fixed_point_t recent_cpu;  /* Recent CPU time received, decayed each second. */
+
+  /* Owned by thread.c, used by "-sched=fair". */
+  int64_t vruntime;            /* Weighted CPU time received. */
+  struct thread* fair_left;    /* Children in the ready heap, ordered by vruntime. */
+  struct thread* fair_right;
+
+  /* Owned by timer.c. */
+  int64_t wakeup_tick;         /* Tick at which a sleeping thread wakes up. */
+  struct thread* sleep_left;   /* Children in the sleep queue, a skew heap ordered by wakeup_tick. */
+  struct thread* sleep_right;
 
 #ifdef USERPROG
   /* Owned by process.c. */
@@ -134,6 +155,7 @@ tid_t thread_create(const char* name, int priority, thread_func*, void*);
 
 void thread_block(void);
 void thread_unblock(struct thread*);
+void thread_preempt(void);
 
 struct thread* thread_current(void);
 tid_t thread_tid(void);
@@ -148,6 +170,9 @@ void thread_foreach(thread_action_func*, void*);
 
 int thread_get_priority(void);
 void thread_set_priority(int);
+void thread_donate_priority(struct thread*, int);
+void thread_refresh_priority(struct thread*);
+bool thread_priority_less(const struct list_elem*, const struct list_elem*, void* aux);
 
 int thread_get_nice(void);
 void thread_set_nice(int);
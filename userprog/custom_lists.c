@@ -1,4 +1,5 @@
 #include "custom_lists.h"
+#include <bitmap.h>
 #include <string.h>
 #include "utils.h"
 
@@ -116,18 +117,30 @@ void L_arg_clear_func(struct list_elem* a_e) {
 
 #pragma region L_fdt
 /**
- * @brief clear function for file descriptor linked list.
- * @note file_close() is called for each file descriptor instead of free().
- * @param a_e a single list element to be freed.
+ * @brief Initialize an empty file descriptor table. No memory is allocated until a descriptor is opened.
  */
-void L_fdt_clear_func(struct list_elem* a_e) {
-  struct L_fdt_elem* e = list_entry(a_e, struct L_fdt_elem, elem);
-  file_close(e->file);
-  free(e);
+void L_fdt_init(L_fdt* a_l) {
+  a_l->fds = NULL;
+  a_l->used = NULL;
+  a_l->capacity = 0;
 }
 
+/**
+ * @brief Close every file descriptor of the table and free it, leaving the table empty.
+ * @note file_close() is called for each file descriptor.
+ */
 void L_fdt_clear(L_fdt* a_l) {
-    list_clear(a_l, L_fdt_clear_func);
+  for (size_t i = 0; i < a_l->capacity; i++) {
+    if (a_l->fds[i] != NULL) {
+      file_close(a_l->fds[i]->file);
+      free(a_l->fds[i]);
+    }
+  }
+  free(a_l->fds);
+  if (a_l->used != NULL) {
+    bitmap_destroy(a_l->used);
+  }
+  L_fdt_init(a_l);
 }
 
 #pragma endregion
@@ -191,17 +204,3 @@ bool L_activeProcs_contains(L_activeProcs* a_l, struct process* a_pcb) {
     }
     return false;
 }
-
-bool L_activeProcs_contains_str(L_activeProcs* a_l, char* a_name) {
-    ASSERT(a_l != NULL);
-    ASSERT(a_name != NULL);
-    struct list_elem* e = list_begin(a_l);
-    while (e != list_end(a_l)) {
-        struct L_activeProcs_elem* elem = list_entry(e, struct L_activeProcs_elem, elem);
-        if (strcmp(elem->name, a_name) == 0) {
-            return true;
-        }
-        e = list_next(e);
-    }
-    return false;
-}
\ No newline at end of file
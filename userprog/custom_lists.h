@@ -32,18 +32,25 @@ L_arg* L_arg_generate(char* a_in);
 void L_arg_clear_func(struct list_elem* a_e);
 
 
+#define FDT_FIRST_ID 3 /*IDs below are reserved for the console*/
+#define FDT_INITIAL_CAPACITY 16 /*Number of descriptors a table has room for when the first one is opened.*/
+
 /**
- * @brief List element a file descriptor table as a list.
- * To look up a file descriptor, iterate through the list and find descriptor with right id.
+ * @brief File descriptor table, an array of descriptors indexed by ID - FDT_FIRST_ID.
+ * To look up a file descriptor, index the array. The array doubles when it is full; a bitmap of the slots in use
+ * gives the lowest free ID to a new descriptor.
  */
-typedef struct list L_fdt;
+typedef struct {
+  struct L_fdt_elem** fds; /*CAPACITY slots, NULL where the ID is free. NULL until the first descriptor is opened.*/
+  struct bitmap* used;     /*Bit I is set if fds[I] is in use.*/
+  size_t capacity;
+} L_fdt;
 struct L_fdt_elem {
   struct file* file;
   int id;
   char file_name[MAX_FILE_NAME];
-  struct list_elem elem;
 };
-void L_fdt_clear_func(struct list_elem* a_e);
+void L_fdt_init(L_fdt* a_l);
 void L_fdt_clear(L_fdt* a_l);
 /**
  * @brief A list of active processes running by the OS.
@@ -57,4 +64,3 @@ struct L_activeProcs_elem {
 bool L_activeProcs_add(L_activeProcs* a_l, struct process* a_pcb, char* a_name);
 void L_activeProcs_remove(L_activeProcs* a_l, struct process* a_pcb);
 bool L_activeProcs_contains(L_activeProcs* a_l, struct process* a_pcb);
-bool L_activeProcs_contains_str(L_activeProcs* a_l, char* a_name);
\ No newline at end of file
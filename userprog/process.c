@@ -20,6 +20,7 @@
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include <bitmap.h>
 #include <list.h>
 #include "lib/utils.h"
 #include "custom_lists.h"
@@ -36,13 +37,6 @@ bool setup_thread(void (**eip)(void), void** esp);
 
 
 #pragma region file
-/**
- * @brief Check if the process with name is currently active.
- * @param a_name 
- */
-bool process_is_active_name(char* a_name) {
-  return L_activeProcs_contains_str(&active_procs, a_name);
-}
 /**
  * @brief Close all opened file descriptors of a process.
  * @param a_pcb pcb of the process whose file descriptors are to be closed.
@@ -51,32 +45,59 @@ void process_clear_L_fdt(struct process* a_pcb) {
   L_fdt_clear(&a_pcb->fdt);
 }
 
-/*helper function for process_fd_open() that generates a none-conflicting FD id.*/
-int generate_fd_id(struct process* a_pcb) {
-  int id = 3; /*0 and 1 are reserved for stdin and stdout*/
-  struct list_elem* e;
-  for (e = list_begin(&a_pcb->fdt); e != list_end(&a_pcb->fdt); e = list_next(e)) {
-    struct L_fdt_elem* fdt_e = list_entry(e, struct L_fdt_elem, elem);
-    if (fdt_e->id == id) {
-      id++;
-    }
+/*helper function for process_fd_open() that doubles the capacity of an FDT, or gives it its initial capacity.*/
+static bool fdt_grow(L_fdt* a_fdt) {
+  size_t capacity = a_fdt->capacity == 0 ? FDT_INITIAL_CAPACITY : a_fdt->capacity * 2;
+  struct bitmap* used = bitmap_create(capacity);
+  if (used == NULL) {
+    return false;
   }
-  return id; 
+  struct L_fdt_elem** fds = realloc(a_fdt->fds, capacity * sizeof *fds);
+  if (fds == NULL) {
+    bitmap_destroy(used);
+    return false;
+  }
+  for (size_t i = a_fdt->capacity; i < capacity; i++) {
+    fds[i] = NULL;
+  }
+  if (a_fdt->used != NULL) { /*every old slot is in use, otherwise the table would not be growing*/
+    bitmap_set_multiple(used, 0, a_fdt->capacity, true);
+    bitmap_destroy(a_fdt->used);
+  }
+  a_fdt->fds = fds;
+  a_fdt->used = used;
+  a_fdt->capacity = capacity;
+  return true;
 }
 
 /**
- * @brief add a file descriptor to a process' FDT.
+ * @brief add a file descriptor to a process' FDT, using the lowest free ID.
  * @param a_pcb process opening the file
  * @param a_file name of the file opened
- * @return ID of the added file descriptor.
+ * @return ID of the added file descriptor, or -1 if out of memory, in which case A_FILE is closed.
  */
 int process_fd_open(struct process* a_pcb, struct file* a_file, char* a_file_name) {
   ASSERT(a_file != NULL);
+  L_fdt* fdt = &a_pcb->fdt;
   struct L_fdt_elem* e = malloc(sizeof(struct L_fdt_elem));
+  if (e == NULL) {
+    file_close(a_file);
+    return -1;
+  }
+  size_t slot = fdt->used == NULL ? BITMAP_ERROR : bitmap_scan_and_flip(fdt->used, 0, 1, false);
+  if (slot == BITMAP_ERROR) { /*table is full*/
+    slot = fdt->capacity;
+    if (!fdt_grow(fdt)) {
+      free(e);
+      file_close(a_file);
+      return -1;
+    }
+    bitmap_mark(fdt->used, slot);
+  }
   e->file = a_file;
-  e->id = generate_fd_id(a_pcb);
+  e->id = slot + FDT_FIRST_ID;
   strlcpy(e->file_name, a_file_name, MIN(strlen(a_file_name) + 1, MAX_FILE_NAME));
-  list_push_back(&a_pcb->fdt, &e->elem);
+  fdt->fds[slot] = e;
   return e->id;
 }
 
@@ -87,17 +108,16 @@ int process_fd_open(struct process* a_pcb, struct file* a_file, char* a_file_nam
  * @return file descriptor of the given ID, or -1 if no corresponding file descriptor is found.
  */
 int process_fd_close(struct process* a_pcb, int a_fd) {
-  struct list_elem* e;
-  for (e = list_begin(&a_pcb->fdt); e != list_end(&a_pcb->fdt); e = list_next(e)) {
-    struct L_fdt_elem* fdt_e = list_entry(e, struct L_fdt_elem, elem);
-    if (fdt_e->id == a_fd) {
-      file_close(fdt_e->file);
-      list_remove(e);
-      free(fdt_e);
-      return 0;
-    }
+  struct L_fdt_elem* fdt_e = process_fd_get(a_pcb, a_fd);
+  if (fdt_e == NULL) {
+    return -1;
   }
-  return -1;
+  size_t slot = a_fd - FDT_FIRST_ID;
+  a_pcb->fdt.fds[slot] = NULL;
+  bitmap_reset(a_pcb->fdt.used, slot);
+  file_close(fdt_e->file);
+  free(fdt_e);
+  return 0;
 }
 
 /**
@@ -107,14 +127,10 @@ int process_fd_close(struct process* a_pcb, int a_fd) {
  * @return file descriptor of the given ID, or NULL if no corresponding file descriptor is found.
  */
 struct L_fdt_elem* process_fd_get(struct process* a_pcb, int a_fd) {
-  struct list_elem* e;
-  for (e = list_begin(&a_pcb->fdt); e != list_end(&a_pcb->fdt); e = list_next(e)) {
-    struct L_fdt_elem* fdt_e = list_entry(e, struct L_fdt_elem, elem);
-    if (fdt_e->id == a_fd) {
-      return fdt_e;
-    }
+  if (a_fd < FDT_FIRST_ID || (size_t)(a_fd - FDT_FIRST_ID) >= a_pcb->fdt.capacity) {
+    return NULL;
   }
-  return NULL;
+  return a_pcb->fdt.fds[a_fd - FDT_FIRST_ID];
 }
 
 #pragma endregion
@@ -418,6 +434,8 @@ static void start_process(void* a_umbilic) {
     // Ensure that timer_interrupt() -> schedule() -> process_activate()
     // does not try to activate our uninitialized pagedir
     new_pcb->pagedir = NULL;
+    new_pcb->executable = NULL;
+    new_pcb->fair_queued_cnt = 0;
     t->pcb = new_pcb;
     // Continue initializing the PCB as normal
     t->pcb->main_thread = t;
@@ -441,7 +459,7 @@ static void start_process(void* a_umbilic) {
   }
   /*initialize fd_list*/
   if (success) {
-    list_init(&t->pcb->fdt); /*initialize file descriptor table*/
+    L_fdt_init(&t->pcb->fdt); /*initialize file descriptor table*/
     list_init(&t->pcb->l_children); /*initialize child process list*/
     list_init(&t->pcb->l_sharedData); /*initialize file list*/
   }
@@ -462,6 +480,7 @@ static void start_process(void* a_umbilic) {
     // can try to activate the pagedir, but it is now freed memory
     struct process* pcb_to_free = t->pcb;
     t->pcb = NULL;
+    file_close(pcb_to_free->executable);
     free(pcb_to_free);
   }
 
@@ -514,6 +533,9 @@ void process_exit(void) {
   }
   /* Close all processes' file descriptors */
   process_clear_L_fdt(pcb);
+  /* Executable may be written again once closed */
+  file_close(pcb->executable);
+  pcb->executable = NULL;
   /* free process's child list*/
   process_clear_L_children(pcb);
   /* proc no longer active*/
@@ -638,6 +660,8 @@ static bool load_segment(struct file* file, off_t ofs, uint8_t* upage, uint32_t
 /* Loads an ELF executable from FILE_NAME into the current thread.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
+   On success the executable is kept open in the PCB with writes
+   denied until the process exits.
    Returns true if successful, false otherwise. */
 bool load(const char* file_name, void (**eip)(void), void** esp) {
   struct thread* t = thread_current();
@@ -729,7 +753,12 @@ bool load(const char* file_name, void (**eip)(void), void** esp) {
 
 done:
   /* We arrive here whether the load is successful or not. */
-  file_close(file);
+  if (success) {
+    file_deny_write(file);
+    t->pcb->executable = file;
+  } else {
+    file_close(file);
+  }
   return success;
 }
 
@@ -19,7 +19,6 @@
 
 L_activeProcs active_procs; /*List of active processes*/
 
-bool process_is_active_name(char* a_name);
 /* PIDs and TIDs are the same type. PID should be
    the TID of the main thread of the process */
 typedef tid_t pid_t;
@@ -47,7 +46,9 @@ struct process {
   char process_name[MAX_FILE_NAME];      /* Name of the main thread */
   struct thread* main_thread; /* Pointer to main thread */
   struct dir* cwd;            /* Current working directory. Must be open.*/
-  L_fdt fdt;          /* File descriptor table implemented as a list.*/
+  struct file* executable;    /* Executable being run, open with writes denied. */
+  int fair_queued_cnt;        /* Threads on the fair scheduler's ready heap. Owned by thread.c. */
+  L_fdt fdt;          /* File descriptor table implemented as an array indexed by ID.*/
   L_children l_children;        /* List of child procs*/
   L_sharedData l_sharedData;   /* List of shared data*/
   struct shared_data* exit_status; /*Shared data for exit status.*/
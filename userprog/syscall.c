@@ -145,13 +145,17 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
       DISPATCH_1ARG(syscall_compute_e_h);
       break;
     case SYS_FILESYS_GET_READ_WRITE_COUNT:
-      DISPATCH_2ARG(syscall_filesys_get_read_write_count_h);
+      DISPATCH_3ARG(syscall_filesys_get_read_write_count_h);
       break;
     case SYS_CACHE_GET_HIT_MISS_TIME:
-      DISPATCH_2ARG(syscall_cache_get_hit_miss_time_h);
+      DISPATCH_3ARG(syscall_cache_get_hit_miss_time_h);
       break;
     case SYS_CACHE_RESET:
       DISPATCH_0ARG(syscall_cache_reset_h);
+    case SYS_CACHE_GET_PREFETCH_STATS:
+      DISPATCH_2ARG(syscall_cache_get_prefetch_stats_h);
+    case SYS_CACHE_GET_CLASS_STATS:
+      DISPATCH_3ARG(syscall_cache_get_class_stats_h);
     case SYS_CHDIR:
       DISPATCH_1ARG(syscall_chdir_h);
     case SYS_MKDIR:
@@ -4,6 +4,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "devices/input.h"
 #include "process.h"
 #include "lib/utils.h"
@@ -13,10 +14,6 @@
 #define LOCK() if (!ENABLE_BUFFER_CACHE) {lock_acquire(&hackyLock);}
 #define UNLOCK() if (!ENABLE_BUFFER_CACHE) {lock_release(&hackyLock);}
 
-bool isFileProtected(const char* a_file) {
-  return process_is_active_name(a_file);
-}
-
 /**Invoked when OS boots. Initialize all static data needed by syscall_fileHandler.*/
 void syscall_fileHandler_init() {
   if (!ENABLE_BUFFER_CACHE) {
@@ -129,11 +126,6 @@ bool syscall_write_h(int a_fd, const void* a_buffer, size_t a_size, void** a_ret
     UNLOCK();
     hRET(-1)
   }
-  if (isFileProtected(fd->file_name)) { /*protected from being written*/
-    UNLOCK();
-    hRET(0)
-  }
-
   struct file* file = fd->file;
   if (inode_is_dir(file_get_inode(file))) {//deny write to directory
     UNLOCK();
@@ -188,19 +180,36 @@ bool syscall_close_h(int a_fd, void** a_ret, struct intr_frame* f UNUSED) {
   return true;
 }
 
-bool syscall_filesys_get_read_write_count_h(unsigned long long* a_read_count, unsigned long long* a_write_count, void** a_ret, struct intr_frame* f UNUSED) {
+/* A_FREE_MAP_WRITE_COUNT is optional; when it is not NULL it receives the number of free map file sectors written.*/
+bool syscall_filesys_get_read_write_count_h(unsigned long long* a_read_count, unsigned long long* a_write_count, unsigned long long* a_free_map_write_count, void** a_ret, struct intr_frame* f UNUSED) {
+  if (a_free_map_write_count != NULL && !VALIDS(a_free_map_write_count, sizeof(unsigned long long))) {
+    return false;
+  }
   *a_read_count = block_get_read_cnt(fs_device);
   *a_write_count = block_get_write_cnt(fs_device);
+  if (a_free_map_write_count != NULL) {
+    *a_free_map_write_count = free_map_get_write_cnt();
+  }
   return true;
 }
 
-bool syscall_cache_get_hit_miss_time_h(int* a_hit_time, int* a_miss_time, void** a_ret, struct intr_frame* f UNUSED) {
+/* A_SIZE is optional; when it is not NULL it receives the number of sectors the buffer cache holds.*/
+bool syscall_cache_get_hit_miss_time_h(int* a_hit_time, int* a_miss_time, int* a_size, void** a_ret, struct intr_frame* f UNUSED) {
+  if (a_size != NULL && !VALIDS(a_size, sizeof(int))) {
+    return false;
+  }
 #if ENABLE_BUFFER_CACHE
   *a_hit_time = buffer_cache_get_hit_time(fs_buffer_cache);
   *a_miss_time = buffer_cache_get_miss_time(fs_buffer_cache);
+  if (a_size != NULL) {
+    *a_size = buffer_cache_get_size(fs_buffer_cache);
+  }
 #else 
   *a_hit_time = -1;
   *a_miss_time = -1;
+  if (a_size != NULL) {
+    *a_size = 0;
+  }
 #endif
   return true;
 }
@@ -213,6 +222,33 @@ bool syscall_cache_reset_h(void** a_ret, struct intr_frame* f UNUSED) {
   return true;
 }
 
+bool syscall_cache_get_prefetch_stats_h(int* a_prefetch_time, int* a_prefetch_hit_time, void** a_ret, struct intr_frame* f UNUSED) {
+  if (!VALIDS(a_prefetch_time, sizeof(int)) || !VALIDS(a_prefetch_hit_time, sizeof(int))) {
+    return false;
+  }
+#if ENABLE_BUFFER_CACHE
+  *a_prefetch_time = buffer_cache_get_prefetch_time(fs_buffer_cache);
+  *a_prefetch_hit_time = buffer_cache_get_prefetch_hit_time(fs_buffer_cache);
+#else
+  *a_prefetch_time = -1;
+  *a_prefetch_hit_time = -1;
+#endif
+  return true;
+}
+
+bool syscall_cache_get_class_stats_h(bool a_metadata, int* a_hit_time, int* a_miss_time, void** a_ret, struct intr_frame* f UNUSED) {
+  if (!VALIDS(a_hit_time, sizeof(int)) || !VALIDS(a_miss_time, sizeof(int))) {
+    return false;
+  }
+#if ENABLE_BUFFER_CACHE
+  buffer_cache_get_class_stats(fs_buffer_cache, a_metadata ? BUFFER_CACHE_META : BUFFER_CACHE_DATA, a_hit_time, a_miss_time);
+#else
+  *a_hit_time = -1;
+  *a_miss_time = -1;
+#endif
+  return true;
+}
+
 bool syscall_chdir_h(const char* a_dir, void** a_ret, struct intr_frame* f UNUSED) {
   if (!VALIDC(a_dir)) {
     return false;
@@ -23,9 +23,11 @@ bool syscall_close_h(int a_fd, void** a_ret, struct intr_frame* f UNUSED);
 void syscall_fileHandler_init();
 
 // Project 4
-bool syscall_filesys_get_read_write_count_h(unsigned long long* a_read_count, unsigned long long* a_write_count, void** a_ret, struct intr_frame* f UNUSED);
-bool syscall_cache_get_hit_miss_time_h(int* a_hit_time, int* a_miss_time, void** a_ret, struct intr_frame* f UNUSED);
+bool syscall_filesys_get_read_write_count_h(unsigned long long* a_read_count, unsigned long long* a_write_count, unsigned long long* a_free_map_write_count, void** a_ret, struct intr_frame* f UNUSED);
+bool syscall_cache_get_hit_miss_time_h(int* a_hit_time, int* a_miss_time, int* a_size, void** a_ret, struct intr_frame* f UNUSED);
 bool syscall_cache_reset_h(void** a_ret, struct intr_frame* f UNUSED);
+bool syscall_cache_get_prefetch_stats_h(int* a_prefetch_time, int* a_prefetch_hit_time, void** a_ret, struct intr_frame* f UNUSED);
+bool syscall_cache_get_class_stats_h(bool a_metadata, int* a_hit_time, int* a_miss_time, void** a_ret, struct intr_frame* f UNUSED);
 
 bool syscall_chdir_h(const char* a_dir, void** a_ret, struct intr_frame* f UNUSED);
 bool syscall_mkdir_h(const char* a_dir, void** a_ret, struct intr_frame* f UNUSED);